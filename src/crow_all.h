@@ -1,3 +1,8 @@
+// LOCALLY MODIFIED: this is Crow 1.0 with one local patch for ecosim.
+// websocket::Connection gains when_written(), which runs a handler once the
+// messages queued so far have been written, so /ws can keep one message in
+// flight per client. Every patched line is marked "ecosim patch"; reapply
+// them after updating this file, or /ws loses its backpressure. See README.md.
 /*BSD 3-Clause License
 
 Copyright (c) 2014-2017, ipkn
@@ -3893,6 +3898,23 @@ namespace crow
                 return adaptor_.remote_endpoint().address().to_string();
             }
 
+            // ecosim patch: begin
+            /// Run a handler once every message queued so far has been written.
+
+            ///
+            /// Must be called on the connection's I/O thread. The handler runs on
+            /// that thread too, and is dropped if the connection fails first.
+            void when_written(std::function<void()> handler)
+            {
+                if (!write_buffers_.empty())
+                    write_handlers_.emplace_back(std::move(handler));
+                else if (!sending_buffers_.empty())
+                    sending_handlers_.emplace_back(std::move(handler));
+                else
+                    post(std::move(handler));
+            }
+            // ecosim patch: end
+
         protected:
             /// Generate the websocket headers using an opcode and the message size (in bytes).
             std::string build_header(int opcode, size_t size)
@@ -4268,6 +4290,7 @@ namespace crow
                 if (sending_buffers_.empty())
                 {
                     sending_buffers_.swap(write_buffers_);
+                    sending_handlers_.swap(write_handlers_); // ecosim patch
                     std::vector<boost::asio::const_buffer> buffers;
                     buffers.reserve(sending_buffers_.size());
                     for (auto& s : sending_buffers_)
@@ -4278,12 +4301,16 @@ namespace crow
                       adaptor_.socket(), buffers,
                       [&](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
                           sending_buffers_.clear();
+                          std::vector<std::function<void()>> written_handlers; // ecosim patch
+                          written_handlers.swap(sending_handlers_);            // ecosim patch
                           if (!ec && !close_connection_)
                           {
                               if (!write_buffers_.empty())
                                   do_write();
                               if (has_sent_close_)
                                   close_connection_ = true;
+                              for (auto& handler : written_handlers) // ecosim patch
+                                  handler();                         // ecosim patch
                           }
                           else
                           {
@@ -4310,6 +4337,8 @@ namespace crow
 
             std::vector<std::string> sending_buffers_;
             std::vector<std::string> write_buffers_;
+            std::vector<std::function<void()>> sending_handlers_; // ecosim patch
+            std::vector<std::function<void()>> write_handlers_;   // ecosim patch
 
             boost::array<char, 4096> buffer_;
             bool is_binary_;
@@ -0,0 +1,647 @@
+#pragma once
+
+#include "grid.hpp"
+#include "lock_table.hpp"
+#include "rng.hpp"
+#include "species.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+
+// Approximate number of cells handed to a worker as one task
+static const uint32_t CELLS_PER_CHUNK = 4096;
+
+// Strategies for applying one iteration to the grid
+enum engine_t
+{
+    // Entities act in place on the live grid while holding their neighbourhood locks
+    engine_locked,
+    // Entities read the current grid without locks and write into a second grid
+    engine_double_buffer,
+    // Entities record intents, conflicts are resolved per target cell, then applied
+    engine_intent,
+    // Entities act in place, one colour class of far-apart cells at a time
+    engine_checkerboard,
+    // Each worker simulates whole tiles in a private copy with a halo around it
+    engine_tiled
+};
+
+// Number of colour classes of the checkerboard engine. Colouring cell (i, j)
+// with (i + 2j) mod 5 gives every cell and its four neighbours distinct
+// colours, so two cells of the same colour are at least three steps apart
+// and their neighbourhoods never overlap.
+static const uint32_t NUM_COLOURS = 5;
+
+inline bool parse_engine(const std::string& name, engine_t& engine) {
+    if (name == "locked") engine = engine_locked;
+    else if (name == "double_buffer") engine = engine_double_buffer;
+    else if (name == "intent") engine = engine_intent;
+    else if (name == "checkerboard") engine = engine_checkerboard;
+    else if (name == "tiled") engine = engine_tiled;
+    else return false;
+    return true;
+}
+
+// Engines that update the live grid, and so need the iterated flags
+inline bool updates_in_place(engine_t engine) {
+    return engine == engine_locked || engine == engine_checkerboard;
+}
+
+// Engines whose result depends only on the seed, not on the number of
+// workers or on how the scheduler interleaves them
+inline bool is_deterministic(engine_t engine) {
+    return engine == engine_intent || engine == engine_checkerboard || engine == engine_tiled;
+}
+
+// One atomic claim word per cell. A cell counts as claimed during an
+// iteration when its word holds that iteration's epoch, so the plane never
+// has to be cleared between iterations.
+class claim_plane_t
+{
+public:
+    void resize(size_t num_cells)
+    {
+        words.reset(new std::atomic<uint32_t>[num_cells]());
+        size = num_cells;
+    }
+
+    void clear()
+    {
+        for (size_t k = 0; k < size; k++) words[k].store(0, std::memory_order_relaxed);
+    }
+
+    // Returns true for the first caller to claim cell k during this epoch
+    bool claim(size_t k, uint32_t epoch)
+    {
+        return words[k].exchange(epoch, std::memory_order_relaxed) != epoch;
+    }
+
+    // True when cell k has been claimed during this epoch
+    bool claimed(size_t k, uint32_t epoch) const
+    {
+        return words[k].load(std::memory_order_relaxed) == epoch;
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint32_t>[]> words;
+    size_t size = 0;
+};
+
+// One atomic bid per cell. Bids carry the iteration epoch in their high
+// half and a priority in the low half; the highest bid of the current epoch
+// wins, whatever order the bids arrive in.
+class bid_plane_t
+{
+public:
+    void resize(size_t num_cells)
+    {
+        words.reset(new std::atomic<uint64_t>[num_cells]());
+        size = num_cells;
+    }
+
+    void clear()
+    {
+        for (size_t k = 0; k < size; k++) words[k].store(0, std::memory_order_relaxed);
+    }
+
+    static uint64_t make_bid(uint32_t epoch, uint32_t priority) { return ((uint64_t)epoch << 32) | priority; }
+
+    void bid(size_t k, uint64_t value)
+    {
+        uint64_t current = words[k].load(std::memory_order_relaxed);
+        while (current < value && !words[k].compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t get(size_t k) const { return words[k].load(std::memory_order_relaxed); }
+
+    // True when some bid was placed on cell k during this epoch
+    bool taken(size_t k, uint32_t epoch) const { return (get(k) >> 32) == epoch; }
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    size_t size = 0;
+};
+
+// What one entity intends to do during an iteration
+struct intent_t
+{
+    uint32_t source;
+    entity_type_t species;
+    action_t action;
+};
+
+// Number of intents handed to a worker as one task while resolving
+static const size_t INTENTS_PER_CHUNK = 4096;
+
+// Side of the square tiles of the tiled engine. A 64x64 tile plus its halo
+// takes about 17KB in the packed layout, so it stays in L1/L2 while simulated.
+static const uint32_t TILE_SIZE = 64;
+
+// Private copy of one tile of the world. The padding around the tile is its
+// halo: it mirrors the neighbouring tiles as they were when the iteration
+// started, or the world's border (walls, or the ghosts of a torus) at the
+// edges. Local cell (i, j) is world cell (first_row + i, first_column + j).
+struct tile_t : packed_grid_t
+{
+    int first_row = 0;
+    int first_column = 0;
+
+    bool in_halo(size_t k) const
+    {
+        size_t row = k / stride;
+        size_t column = k % stride;
+        return row == 0 || column == 0 || row == height + 1 || column == width + 1;
+    }
+
+    // World coordinates of local cell k; halo cells lie one step past the edge
+    int world_row(size_t k) const { return first_row + (int)(k / stride) - 1; }
+    int world_column(size_t k) const { return first_column + (int)(k % stride) - 1; }
+};
+
+// An action of a tile's entity that lands on a cell owned by another tile.
+// It is applied after every tile has finished, if the source still holds
+// the entity and the target still holds what the entity saw.
+struct outbox_entry_t
+{
+    size_t source;
+    size_t target;
+    entity_type_t expected;
+    action_t action;
+};
+
+// Drops the per-iteration flags before an entity is stored for good
+inline entity_t settled(entity_t e) {
+    e.clear_flag(ENTITY_FLAG_ITERATED);
+    return e;
+}
+
+// Writes e into a cell of a grid cleared at the start of the iteration,
+// skipping the planes whose field stays zero
+template <typename grid_type>
+void put_cleared(grid_type& grid, size_t k, entity_t e) {
+    grid.put(k, e, changed_fields(entity_t(), e));
+}
+
+// Everything the engines need to advance the simulation
+template <typename grid_type>
+struct world_t
+{
+    engine_t engine = engine_locked;
+
+    // State of the last completed iteration
+    grid_type grid;
+
+    // Double-buffered and intent engines: the iteration being written
+    grid_type next;
+    uint32_t epoch = 0;
+
+    // Key of the random streams: the run's seed and the iteration number
+    uint64_t seed = 0;
+    uint64_t tick = 0;
+
+    // One buffer per worker for the random blocks of the row it is simulating
+    std::vector<std::vector<uint32_t>> random_blocks;
+
+    // Double-buffered engine: entities and empty cells already taken
+    claim_plane_t fates;
+    claim_plane_t slots;
+
+    // Intent engine: one intent buffer per worker, and the bids on each cell
+    std::vector<std::vector<intent_t>> intents;
+    bid_plane_t bids;
+
+    // Tiled engine: one scratch tile per worker, one outbox per tile
+    std::vector<tile_t> tiles;
+    std::vector<std::vector<outbox_entry_t>> outboxes;
+
+    uint32_t tiles_across() const { return (grid.width + TILE_SIZE - 1) / TILE_SIZE; }
+    uint32_t tiles_down() const { return (grid.height + TILE_SIZE - 1) / TILE_SIZE; }
+
+    void reset(engine_t engine, uint32_t width, uint32_t height, bool torus, size_t num_workers)
+    {
+        this->engine = engine;
+        grid.resize(width, height, torus);
+
+        if (!updates_in_place(engine)) {
+            next.resize(width, height, torus);
+        }
+        if (engine == engine_double_buffer) {
+            fates.resize(grid.size());
+            slots.resize(grid.size());
+        }
+        if (engine == engine_intent) {
+            intents.assign(num_workers, std::vector<intent_t>());
+            bids.resize(grid.size());
+        }
+        if (engine == engine_tiled) {
+            tiles.assign(num_workers, tile_t());
+            outboxes.assign((size_t)tiles_across() * tiles_down(), std::vector<outbox_entry_t>());
+        }
+        random_blocks.assign(num_workers, std::vector<uint32_t>());
+        epoch = 0;
+        tick = 0;
+    }
+
+    // Computes the first random block of the world cells first_cell,
+    // first_cell + step, ... (count of them) into the worker's buffer, in one batch
+    const uint32_t* random_row(size_t worker, size_t first_cell, size_t step, size_t count)
+    {
+        std::vector<uint32_t>& buffer = random_blocks[worker];
+        if (buffer.size() < 4 * count) buffer.resize(4 * count);
+        philox4x32_cells(seed, tick, first_cell, step, count, buffer.data());
+        return buffer.data();
+    }
+
+    // Random stream of the entity acting from world cell k this iteration,
+    // given the cell's block from random_row
+    cell_rng_t rng(size_t k, const uint32_t* block) const { return cell_rng_t(seed, tick, (uint32_t)k, block); }
+
+    uint32_t next_epoch()
+    {
+        if (++epoch == 0) {
+            fates.clear();
+            slots.clear();
+            bids.clear();
+            epoch = 1;
+        }
+        return epoch;
+    }
+};
+
+// Splits the rows of the grid into chunks and queues them on the worker pool.
+// fn(first_row, last_row, worker) runs once per chunk; call pool.join() to wait.
+template <typename grid_type, typename fn_t>
+void dispatch_rows(thread_pool_t& pool, const grid_type& grid, fn_t fn) {
+    uint32_t rows_per_chunk = std::max<uint32_t>(1, CELLS_PER_CHUNK / std::max<uint32_t>(grid.width, 1));
+    size_t num_chunks = (grid.height + rows_per_chunk - 1) / rows_per_chunk;
+    uint32_t height = grid.height;
+
+    pool.dispatch(num_chunks, [fn, rows_per_chunk, height](size_t chunk, size_t worker) {
+        int first_row = (int)(chunk * rows_per_chunk);
+        int last_row = (int)std::min<size_t>((size_t)first_row + rows_per_chunk, height);
+        fn(first_row, last_row, worker);
+    });
+}
+
+// Locks cell (i, j) together with its von Neumann neighbours
+template <typename grid_type>
+stripe_lock_t lock_neighbourhood(lock_table_t& locks, const grid_type& grid, int i, int j) {
+    size_t cells[lock_table_t::MAXIMUM_LOCKED_CELLS];
+    cells[0] = grid.index(i, j);
+    size_t count = 1 + grid.neighbours(i, j, cells + 1);
+
+    return stripe_lock_t(locks, cells, count);
+}
+
+// Simulates the entity in cell (i, j) directly on the live grid, unless it
+// already acted during this iteration. The caller must make sure nobody else
+// touches the neighbourhood meanwhile.
+template <typename grid_type>
+void simulate_cell_in_place(world_t<grid_type>& world, int i, int j, const uint32_t* block) {
+    grid_type& grid = world.grid;
+    size_t k = grid.index(i, j);
+    if (grid.type(k) == empty || grid.has_flag(k, ENTITY_FLAG_ITERATED)) return;
+
+    cell_rng_t rng = world.rng(k, block);
+    action_t action = decide(grid, i, j, rng);
+    grid.put(k, action.self, action.self_fields);
+    if (action.kind != action_none) grid.put(action.target, action.spawned);
+}
+
+// Locked engine: holds the neighbourhood of (i, j) while simulating it
+template <typename grid_type>
+void simulate_cell_locked(lock_table_t& locks, world_t<grid_type>& world, int i, int j, const uint32_t* block) {
+    stripe_lock_t lock = lock_neighbourhood(locks, world.grid, i, j);
+    simulate_cell_in_place(world, i, j, block);
+}
+
+// Checkerboard engine: sweeps one colour class over the whole grid. Cells of
+// the same colour have disjoint neighbourhoods, so the sweep runs in parallel
+// without locks and keeps the in-place update semantics.
+template <typename grid_type>
+void dispatch_colour(thread_pool_t& pool, world_t<grid_type>& world, uint32_t colour) {
+    dispatch_rows(pool, world.grid, [&world, colour](int first_row, int last_row, size_t worker) {
+        for (int i=first_row; i<last_row; i++) {
+            // First column of this colour in row i: i + 2j == colour (mod 5), and 2 * 3 == 1 (mod 5)
+            int first_column = (int)((3 * (colour + NUM_COLOURS - i % NUM_COLOURS)) % NUM_COLOURS);
+            if (first_column >= (int)world.grid.width) continue;
+            size_t count = (world.grid.width - first_column + NUM_COLOURS - 1) / NUM_COLOURS;
+            const uint32_t* blocks = world.random_row(worker, world.grid.index(i, first_column), NUM_COLOURS, count);
+            for (size_t n = 0; n < count; n++) {
+                simulate_cell_in_place(world, i, first_column + (int)(n * NUM_COLOURS), blocks + 4 * n);
+            }
+        }
+    });
+}
+
+// Double-buffered engine: decides from the current grid, which nobody
+// writes during the iteration, and records the outcome in the next grid.
+// Conflicts are settled with claims instead of locks. Eating is settled
+// first, top-down, so prey is never safe just because the sweep reached it
+// before its predator: carnivores that eat claim the fate of their prey, then
+// herbivores that were not eaten and eat claim the fate of their plant. In
+// the last pass every entity left claims its own fate (it fails if the entity
+// was eaten or already acted), and entities moving or spawning into an empty
+// cell claim that cell. Whoever loses a claim keeps its fallback state in place.
+// eaters is the species settled by this pass, or empty for the last pass.
+template <typename grid_type>
+void simulate_cell_double_buffered(world_t<grid_type>& world, uint32_t epoch, entity_type_t eaters,
+                                   int i, int j, const uint32_t* block) {
+    const grid_type& current = world.grid;
+    grid_type& next = world.next;
+
+    size_t k = current.index(i, j);
+    entity_type_t type = current.type(k);
+    if (type == empty || world.fates.claimed(k, epoch)) return;
+    if (eaters != empty && type != eaters) return;
+
+    cell_rng_t rng = world.rng(k, block);
+    action_t action = decide(current, i, j, rng);
+    if (eaters != empty && action.kind != action_eat) return;
+
+    // Nobody else claims this cell's fate during this pass
+    world.fates.claim(k, epoch);
+    action.self.clear_flag(ENTITY_FLAG_ITERATED);
+    action.spawned.clear_flag(ENTITY_FLAG_ITERATED);
+    action.fallback.clear_flag(ENTITY_FLAG_ITERATED);
+
+    bool taken = false;
+    if (action.kind == action_eat) taken = world.fates.claim(action.target, epoch);
+    else if (action.kind != action_none) taken = world.slots.claim(action.target, epoch);
+
+    entity_t self = action.kind == action_none || taken ? action.self : action.fallback;
+    if (self.type() != empty) put_cleared(next, k, self);
+    if (taken) put_cleared(next, action.target, action.spawned);
+}
+
+// Splits every worker's intent buffer into chunks and queues them on the pool.
+// fn(intent) runs once per intent; call pool.join() to wait.
+template <typename fn_t>
+void dispatch_intents(thread_pool_t& pool, const std::vector<std::vector<intent_t>>& intents, fn_t fn) {
+    std::vector<std::pair<size_t, size_t>> chunks;
+    for (size_t b = 0; b < intents.size(); b++) {
+        for (size_t first = 0; first < intents[b].size(); first += INTENTS_PER_CHUNK) {
+            chunks.push_back(std::make_pair(b, first));
+        }
+    }
+
+    pool.dispatch(chunks.size(), [&intents, fn, chunks](size_t chunk, size_t) {
+        const std::vector<intent_t>& buffer = intents[chunks[chunk].first];
+        size_t last = std::min(buffer.size(), chunks[chunk].second + INTENTS_PER_CHUNK);
+        for (size_t n = chunks[chunk].second; n < last; n++) {
+            fn(buffer[n]);
+        }
+    });
+}
+
+// Priority of an entity when several intents target the same cell. Mixing
+// the cell index with the iteration keeps the choice fair across iterations,
+// and the mix is a bijection, so two sources never tie.
+inline uint32_t intent_priority(uint32_t source, uint32_t epoch) {
+    uint32_t x = source + epoch * 0x9E3779B9u;
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Intent engine. Every entity first records what it wants to do, reading the
+// current grid only. Conflicts are then settled per target cell: the highest
+// priority bid wins, which does not depend on thread count or timing.
+// Eating is resolved top-down (carnivores, then herbivores that were not
+// eaten), then moves, births and growth into empty cells from entities that
+// survived. Finally every surviving entity writes its outcome into the next
+// grid, each cell by exactly one writer. No phase takes a lock.
+template <typename grid_type>
+void simulate_intents(thread_pool_t& pool, world_t<grid_type>& world) {
+    uint32_t epoch = world.next_epoch();
+    const grid_type& current = world.grid;
+    grid_type& next = world.next;
+    bid_plane_t& bids = world.bids;
+
+    // Intent: decide every entity into its worker's buffer
+    for (std::vector<intent_t>& buffer : world.intents) buffer.clear();
+    dispatch_rows(pool, current, [&world, &current](int first_row, int last_row, size_t worker) {
+        std::vector<intent_t>& buffer = world.intents[worker];
+        for (int i=first_row; i<last_row; i++) {
+            const uint32_t* blocks = world.random_row(worker, current.index(i, 0), 1, current.width);
+            for (int j=0; j<(int)current.width; j++) {
+                size_t k = current.index(i, j);
+                if (current.type(k) == empty) continue;
+
+                intent_t intent;
+                intent.source = (uint32_t)k;
+                intent.species = current.type(k);
+                cell_rng_t rng = world.rng(k, blocks + 4 * j);
+                intent.action = decide(current, i, j, rng);
+                intent.action.self.clear_flag(ENTITY_FLAG_ITERATED);
+                intent.action.spawned.clear_flag(ENTITY_FLAG_ITERATED);
+                intent.action.fallback.clear_flag(ENTITY_FLAG_ITERATED);
+                buffer.push_back(intent);
+            }
+        }
+    });
+    pool.join();
+
+    // Resolve: carnivores bid on their prey
+    dispatch_intents(pool, world.intents, [&bids, epoch](const intent_t& intent) {
+        if (intent.species != carnivore || intent.action.kind != action_eat) return;
+        bids.bid(intent.action.target, bid_plane_t::make_bid(epoch, intent_priority(intent.source, epoch)));
+    });
+    pool.join();
+
+    // Resolve: herbivores that were not eaten bid on plants
+    dispatch_intents(pool, world.intents, [&bids, epoch](const intent_t& intent) {
+        if (intent.species != herbivore || intent.action.kind != action_eat) return;
+        if (bids.taken(intent.source, epoch)) return;
+        bids.bid(intent.action.target, bid_plane_t::make_bid(epoch, intent_priority(intent.source, epoch)));
+    });
+    pool.join();
+
+    // Resolve: survivors bid on the empty cells they grow, breed or move into
+    dispatch_intents(pool, world.intents, [&bids, epoch](const intent_t& intent) {
+        if (intent.action.kind == action_none || intent.action.kind == action_eat) return;
+        if (bids.taken(intent.source, epoch)) return;
+        bids.bid(intent.action.target, bid_plane_t::make_bid(epoch, intent_priority(intent.source, epoch)));
+    });
+    pool.join();
+
+    // Apply: survivors write their outcome, winners also write their target
+    dispatch_intents(pool, world.intents, [&bids, &next, epoch](const intent_t& intent) {
+        if (bids.taken(intent.source, epoch)) return;
+
+        const action_t& action = intent.action;
+        bool won = action.kind != action_none &&
+                   bids.get(action.target) == bid_plane_t::make_bid(epoch, intent_priority(intent.source, epoch));
+
+        entity_t self = action.kind == action_none || won ? action.self : action.fallback;
+        if (self.type() != empty) put_cleared(next, intent.source, self);
+        if (won) put_cleared(next, action.target, action.spawned);
+    });
+}
+
+// Tiled engine: loads one tile and its halo into the worker's scratch tile,
+// simulates the tile in place in row-major order, and writes it back into
+// the next grid. Actions that land on the halo go to the tile's outbox.
+template <typename grid_type>
+void simulate_tile(world_t<grid_type>& world, size_t tile_number, size_t worker) {
+    const grid_type& current = world.grid;
+    grid_type& next = world.next;
+    tile_t& tile = world.tiles[worker];
+    std::vector<outbox_entry_t>& outbox = world.outboxes[tile_number];
+    outbox.clear();
+
+    tile.first_row = (int)((tile_number / world.tiles_across()) * TILE_SIZE);
+    tile.first_column = (int)((tile_number % world.tiles_across()) * TILE_SIZE);
+    int rows = (int)std::min<uint32_t>(TILE_SIZE, current.height - tile.first_row);
+    int columns = (int)std::min<uint32_t>(TILE_SIZE, current.width - tile.first_column);
+    if ((int)tile.height != rows || (int)tile.width != columns) tile.resize(columns, rows);
+
+    // Load the tile and its halo, walls included
+    for (int i=-1; i<=rows; i++) {
+        size_t source = current.index(tile.first_row + i, tile.first_column - 1);
+        size_t destination = tile.index(i, -1);
+        for (int j=0; j<columns+2; j++) {
+            tile.put(destination + j, settled(current.get(source + j)));
+        }
+    }
+
+    // Simulate the interior
+    for (int i=0; i<rows; i++) {
+        size_t first_cell = current.index(tile.first_row + i, tile.first_column);
+        const uint32_t* blocks = world.random_row(worker, first_cell, 1, columns);
+        for (int j=0; j<columns; j++) {
+            size_t k = tile.index(i, j);
+            if (tile.type(k) == empty || tile.has_flag(k, ENTITY_FLAG_ITERATED)) continue;
+
+            cell_rng_t rng = world.rng(first_cell + j, blocks + 4 * j);
+            action_t action = decide(tile, i, j, rng);
+            if (action.kind != action_none && tile.in_halo(action.target)) {
+                // Stay put for now; the outbox applies the rest if it still can
+                tile.put(k, action.fallback);
+                outbox_entry_t entry;
+                entry.source = current.index(tile.world_row(k), tile.world_column(k));
+                entry.target = current.wrapped_index(tile.world_row(action.target), tile.world_column(action.target));
+                entry.expected = tile.type(action.target);
+                entry.action = action;
+                outbox.push_back(entry);
+                continue;
+            }
+
+            tile.put(k, action.self);
+            if (action.kind != action_none) tile.put(action.target, action.spawned);
+        }
+    }
+
+    // Write the interior back
+    for (int i=0; i<rows; i++) {
+        for (int j=0; j<columns; j++) {
+            next.put(next.index(tile.first_row + i, tile.first_column + j), settled(tile.get(tile.index(i, j))));
+        }
+    }
+}
+
+// Tiled engine: applies the cross-tile actions in tile order, so the result
+// does not depend on which worker finished first
+template <typename grid_type>
+void apply_outboxes(world_t<grid_type>& world) {
+    grid_type& next = world.next;
+    for (const std::vector<outbox_entry_t>& outbox : world.outboxes) {
+        for (const outbox_entry_t& entry : outbox) {
+            if (next.get(entry.source).bits != settled(entry.action.fallback).bits) continue;
+            if (next.type(entry.target) != entry.expected) continue;
+
+            next.put(entry.source, settled(entry.action.self));
+            next.put(entry.target, settled(entry.action.spawned));
+        }
+    }
+}
+
+// Reset phase: prepares the buffers the engine writes during the iteration
+template <typename grid_type>
+void begin_tick(thread_pool_t& pool, world_t<grid_type>& world) {
+    if (updates_in_place(world.engine)) {
+        // Nobody has acted yet in this iteration
+        grid_type& grid = world.grid;
+        dispatch_rows(pool, grid, [&grid](int first_row, int last_row, size_t) {
+            for (size_t k = grid.index(first_row, -1); k < grid.index(last_row, -1); k++) {
+                grid.clear_flag(k, ENTITY_FLAG_ITERATED);
+            }
+        });
+    }
+    else if (world.engine == engine_tiled) {
+        // Tiles load their halo straight from the padding
+        world.grid.refresh_ghosts();
+    }
+    else {
+        // Cells nobody writes during the iteration end up empty
+        grid_type& next = world.next;
+        dispatch_rows(pool, next, [&next](int first_row, int last_row, size_t) {
+            for (int i=first_row; i<last_row; i++) {
+                next.clear(next.index(i, 0), next.index(i, next.width));
+            }
+        });
+    }
+    pool.join();
+}
+
+// Simulate phase: queues the work of the iteration on the pool; the last
+// batch is left running for the caller's barrier
+template <typename grid_type>
+void simulate_tick(thread_pool_t& pool, lock_table_t& locks, world_t<grid_type>& world) {
+    if (world.engine == engine_locked) {
+        dispatch_rows(pool, world.grid, [&locks, &world](int first_row, int last_row, size_t worker) {
+            for (int i=first_row; i<last_row; i++) {
+                const uint32_t* blocks = world.random_row(worker, world.grid.index(i, 0), 1, world.grid.width);
+                for (int j=0; j<(int)world.grid.width; j++) {
+                    simulate_cell_locked(locks, world, i, j, blocks + 4 * j);
+                }
+            }
+        });
+    }
+    else if (world.engine == engine_intent) {
+        simulate_intents(pool, world);
+    }
+    else if (world.engine == engine_tiled) {
+        pool.dispatch(world.outboxes.size(), [&world](size_t tile_number, size_t worker) {
+            simulate_tile(world, tile_number, worker);
+        });
+        pool.join();
+        pool.dispatch(1, [&world](size_t, size_t) { apply_outboxes(world); });
+    }
+    else if (world.engine == engine_checkerboard) {
+        for (uint32_t colour = 0; colour < NUM_COLOURS; colour++) {
+            if (colour > 0) pool.join();
+            dispatch_colour(pool, world, colour);
+        }
+    }
+    else {
+        // Carnivores eat, then herbivores eat, then everything left acts
+        const entity_type_t passes[] = {carnivore, herbivore, empty};
+        uint32_t epoch = world.next_epoch();
+        for (entity_type_t eaters : passes) {
+            if (eaters != carnivore) pool.join();
+            dispatch_rows(pool, world.grid, [&world, epoch, eaters](int first_row, int last_row, size_t worker) {
+                for (int i=first_row; i<last_row; i++) {
+                    const uint32_t* blocks = world.random_row(worker, world.grid.index(i, 0), 1, world.grid.width);
+                    for (int j=0; j<(int)world.grid.width; j++) {
+                        simulate_cell_double_buffered(world, epoch, eaters, i, j, blocks + 4 * j);
+                    }
+                }
+            });
+        }
+    }
+}
+
+// Runs after the barrier, once every chunk has been applied
+template <typename grid_type>
+void end_tick(world_t<grid_type>& world) {
+    if (!updates_in_place(world.engine)) {
+        std::swap(world.grid, world.next);
+    }
+    world.tick++;
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "grid.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Symbol of each entity type in the frames sent to clients
+const char ENTITY_SYMBOLS[] = {' ', 'P', 'H', 'C'};
+
+// Longest and shortest cell of a JSON frame, separating comma included. The
+// brackets around each row make up for the comma its last cell lacks, so a
+// JSON frame takes at least MINIMUM_JSON_CELL_LENGTH bytes per cell.
+const size_t MAXIMUM_JSON_CELL_LENGTH = sizeof("{\"age\":255,\"energy\":4095,\"type\":\"C\"},") - 1;
+const size_t MINIMUM_JSON_CELL_LENGTH = sizeof("{\"age\":0,\"energy\":0,\"type\":\" \"},") - 1;
+
+// Writes value in decimal at p and returns the end
+inline char* write_uint(char* p, uint64_t value) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (n > 0) *p++ = digits[--n];
+    return p;
+}
+
+template <size_t N>
+char* write_literal(char* p, const char (&text)[N]) {
+    std::memcpy(p, text, N - 1);
+    return p + N - 1;
+}
+
+// Binary frames, for clients that ask for application/octet-stream. Numbers
+// are little-endian:
+//   bytes 0-3    magic "ECO1"
+//   bytes 4-7    width
+//   bytes 8-11   height
+//   bytes 12-19  tick
+//   bytes 20-23  planes present (FRAME_PLANE_* bits)
+// followed by each plane present, in bit order, covering the cells in
+// row-major order: type (1 byte per cell: 0 empty, 1 plant, 2 herbivore,
+// 3 carnivore), age (1 byte per cell) and energy (2 bytes per cell).
+const uint32_t FRAME_PLANE_TYPE = 1u << 0;
+const uint32_t FRAME_PLANE_AGE = 1u << 1;
+const uint32_t FRAME_PLANE_ENERGY = 1u << 2;
+const uint32_t FRAME_ALL_PLANES = FRAME_PLANE_TYPE | FRAME_PLANE_AGE | FRAME_PLANE_ENERGY;
+const size_t BINARY_FRAME_HEADER_SIZE = 24;
+
+// Bytes each cell takes in the given planes; the type plane is always present
+inline size_t plane_bytes(uint32_t planes) {
+    return 1 + ((planes & FRAME_PLANE_AGE) ? 1 : 0) + ((planes & FRAME_PLANE_ENERGY) ? 2 : 0);
+}
+
+inline char* write_le(char* p, uint64_t value, int num_bytes) {
+    for (int b = 0; b < num_bytes; b++) *p++ = (char)(value >> (8 * b));
+    return p;
+}
+
+inline uint64_t read_le(const char* p, int num_bytes) {
+    uint64_t value = 0;
+    for (int b = 0; b < num_bytes; b++) value |= (uint64_t)(uint8_t)p[b] << (8 * b);
+    return value;
+}
+
+inline char* write_binary_header(char* p, uint32_t width, uint32_t height, uint64_t tick, uint32_t planes) {
+    p = write_literal(p, "ECO1");
+    p = write_le(p, width, 4);
+    p = write_le(p, height, 4);
+    p = write_le(p, tick, 8);
+    return write_le(p, planes, 4);
+}
+
+// Serialises one iteration as a binary frame with every plane. out is
+// overwritten and keeps its capacity.
+template <typename grid_type>
+void write_binary_frame(std::string& out, uint64_t tick, const grid_type& grid) {
+    size_t num_cells = (size_t)grid.width * grid.height;
+    out.resize(BINARY_FRAME_HEADER_SIZE + 4 * num_cells);
+
+    char* p = write_binary_header(&out[0], grid.width, grid.height, tick, FRAME_ALL_PLANES);
+    char* types = p;
+    char* ages = types + num_cells;
+    char* energies = ages + num_cells;
+    for (uint32_t i = 0; i < grid.height; i++) {
+        for (uint32_t j = 0; j < grid.width; j++) {
+            size_t k = grid.index(i, j);
+            *types++ = (char)grid.type(k);
+            *ages++ = (char)grid.age(k);
+            energies = write_le(energies, (uint64_t)grid.energy(k), 2);
+        }
+    }
+}
+
+// Copies the given planes of a binary frame written by write_binary_frame
+// into out. The type plane is always included.
+inline void select_planes(const std::string& full, uint32_t planes, std::string& out) {
+    planes |= FRAME_PLANE_TYPE;
+    uint32_t width = (uint32_t)read_le(full.data() + 4, 4);
+    uint32_t height = (uint32_t)read_le(full.data() + 8, 4);
+    uint64_t tick = read_le(full.data() + 12, 8);
+    size_t num_cells = (size_t)width * height;
+
+    out.resize(BINARY_FRAME_HEADER_SIZE);
+    write_binary_header(&out[0], width, height, tick, planes);
+    const char* plane = full.data() + BINARY_FRAME_HEADER_SIZE;
+    out.append(plane, num_cells);
+    if (planes & FRAME_PLANE_AGE) out.append(plane + num_cells, num_cells);
+    if (planes & FRAME_PLANE_ENERGY) out.append(plane + 2 * num_cells, 2 * num_cells);
+}
+
+// Appends to changed the row-major index of every cell that differs between
+// two binary frames of the same grid, both written by write_binary_frame,
+// and to retyped the index of every cell whose type differs
+inline void diff_binary_frames(const std::string& before, const std::string& after,
+                               std::vector<uint32_t>& changed, std::vector<uint32_t>& retyped) {
+    size_t num_cells = (after.size() - BINARY_FRAME_HEADER_SIZE) / 4;
+    const char* old_types = before.data() + BINARY_FRAME_HEADER_SIZE;
+    const char* new_types = after.data() + BINARY_FRAME_HEADER_SIZE;
+    const char* old_ages = old_types + num_cells;
+    const char* new_ages = new_types + num_cells;
+    const char* old_energies = old_ages + num_cells;
+    const char* new_energies = new_ages + num_cells;
+    for (size_t k = 0; k < num_cells; k++) {
+        if (old_types[k] != new_types[k]) retyped.push_back((uint32_t)k);
+        if (old_types[k] != new_types[k] || old_ages[k] != new_ages[k] ||
+            old_energies[2 * k] != new_energies[2 * k] || old_energies[2 * k + 1] != new_energies[2 * k + 1]) {
+            changed.push_back((uint32_t)k);
+        }
+    }
+}
+
+// Serialises the iteration in a binary frame written by write_binary_frame as
+//   {"grid":[[{"age":A,"energy":E,"type":"S"},...],...],"height":H,"tick":T,"width":W}
+// byte for byte what nlohmann::json dumped from the equivalent DOM (objects
+// with sorted keys), but streamed straight into out without building the DOM.
+// Reading the binary frame lets the JSON be written only once a client asks for it.
+inline void write_json_frame(std::string& out, const std::string& full) {
+    uint32_t width = (uint32_t)read_le(full.data() + 4, 4);
+    uint32_t height = (uint32_t)read_le(full.data() + 8, 4);
+    uint64_t tick = read_le(full.data() + 12, 8);
+    size_t num_cells = (size_t)width * height;
+    const char* types = full.data() + BINARY_FRAME_HEADER_SIZE;
+    const char* ages = types + num_cells;
+    const char* energies = ages + num_cells;
+
+    out.resize(128 + (size_t)height * (3 + (size_t)width * MAXIMUM_JSON_CELL_LENGTH));
+
+    char* p = &out[0];
+    p = write_literal(p, "{\"grid\":[");
+    for (uint32_t i = 0; i < height; i++) {
+        if (i > 0) *p++ = ',';
+        *p++ = '[';
+        for (uint32_t j = 0; j < width; j++) {
+            size_t k = (size_t)i * width + j;
+            if (j > 0) *p++ = ',';
+            p = write_literal(p, "{\"age\":");
+            p = write_uint(p, (uint8_t)ages[k]);
+            p = write_literal(p, ",\"energy\":");
+            p = write_uint(p, read_le(energies + 2 * k, 2));
+            p = write_literal(p, ",\"type\":\"");
+            *p++ = ENTITY_SYMBOLS[(uint8_t)types[k]];
+            p = write_literal(p, "\"}");
+        }
+        *p++ = ']';
+    }
+    p = write_literal(p, "],\"height\":");
+    p = write_uint(p, height);
+    p = write_literal(p, ",\"tick\":");
+    p = write_uint(p, tick);
+    p = write_literal(p, ",\"width\":");
+    p = write_uint(p, width);
+    *p++ = '}';
+
+    out.resize(p - out.data());
+}
+
+// Serialises the cells listed in changed (row-major indices), with their
+// values in the binary frame full, as
+//   {"changes":[[index,{"age":A,"energy":E,"type":"S"}],...],"height":H,"since":S,"tick":T,"width":W}
+inline void write_json_delta(std::string& out, uint64_t since, const std::string& full, const std::vector<uint32_t>& changed) {
+    uint32_t width = (uint32_t)read_le(full.data() + 4, 4);
+    uint32_t height = (uint32_t)read_le(full.data() + 8, 4);
+    uint64_t tick = read_le(full.data() + 12, 8);
+    size_t num_cells = (size_t)width * height;
+    const char* types = full.data() + BINARY_FRAME_HEADER_SIZE;
+    const char* ages = types + num_cells;
+    const char* energies = ages + num_cells;
+
+    const size_t MAXIMUM_CHANGE_LENGTH = sizeof("[4294967295,{\"age\":255,\"energy\":4095,\"type\":\"C\"}],") - 1;
+    out.resize(160 + changed.size() * MAXIMUM_CHANGE_LENGTH);
+
+    char* p = &out[0];
+    p = write_literal(p, "{\"changes\":[");
+    for (size_t n = 0; n < changed.size(); n++) {
+        uint32_t k = changed[n];
+        if (n > 0) *p++ = ',';
+        *p++ = '[';
+        p = write_uint(p, k);
+        p = write_literal(p, ",{\"age\":");
+        p = write_uint(p, (uint8_t)ages[k]);
+        p = write_literal(p, ",\"energy\":");
+        p = write_uint(p, read_le(energies + 2 * k, 2));
+        p = write_literal(p, ",\"type\":\"");
+        *p++ = ENTITY_SYMBOLS[(uint8_t)types[k]];
+        p = write_literal(p, "\"}]");
+    }
+    p = write_literal(p, "],\"height\":");
+    p = write_uint(p, height);
+    p = write_literal(p, ",\"since\":");
+    p = write_uint(p, since);
+    p = write_literal(p, ",\"tick\":");
+    p = write_uint(p, tick);
+    p = write_literal(p, ",\"width\":");
+    p = write_uint(p, width);
+    *p++ = '}';
+
+    out.resize(p - out.data());
+}
+
+// Binary delta frames have a 36-byte little-endian header:
+//   bytes 0-3    magic "ECD1"
+//   bytes 4-7    width
+//   bytes 8-11   height
+//   bytes 12-19  tick
+//   bytes 20-23  planes present (FRAME_PLANE_* bits)
+//   bytes 24-31  tick the delta starts from
+//   bytes 32-35  number of changed cells
+// followed by each changed cell: row-major index (4 bytes), then its
+// fields in the planes present, in bit order: type, age (1 byte each) and
+// energy (2 bytes).
+const size_t BINARY_DELTA_HEADER_SIZE = 36;
+
+inline void write_binary_delta(std::string& out, uint64_t since, const std::string& full, uint32_t planes,
+                               const std::vector<uint32_t>& changed) {
+    planes |= FRAME_PLANE_TYPE;
+    size_t num_cells = (full.size() - BINARY_FRAME_HEADER_SIZE) / 4;
+    const char* types = full.data() + BINARY_FRAME_HEADER_SIZE;
+    const char* ages = types + num_cells;
+    const char* energies = ages + num_cells;
+
+    out.resize(BINARY_DELTA_HEADER_SIZE + (4 + plane_bytes(planes)) * changed.size());
+    char* p = write_literal(&out[0], "ECD1");
+    std::memcpy(p, full.data() + 4, 16);  // width, height and tick
+    p = write_le(p + 16, planes, 4);
+    p = write_le(p, since, 8);
+    p = write_le(p, changed.size(), 4);
+    for (uint32_t k : changed) {
+        p = write_le(p, k, 4);
+        *p++ = types[k];
+        if (planes & FRAME_PLANE_AGE) *p++ = ages[k];
+        if (planes & FRAME_PLANE_ENERGY) {
+            *p++ = energies[2 * k];
+            *p++ = energies[2 * k + 1];
+        }
+    }
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Type definitions
+enum entity_type_t
+{
+    empty,
+    plant,
+    herbivore,
+    carnivore,
+    // Sentinel filling the border around the grid; never simulated
+    wall
+};
+
+// Flag bits stored alongside each entity
+const uint32_t ENTITY_FLAG_ITERATED = 1u << 0;
+
+// An entity packed into a single 32-bit word:
+//   bits  0-2   type
+//   bits  3-10  age     (saturates at 255)
+//   bits 11-22  energy  (saturates at 4095)
+//   bits 23-31  flags
+struct entity_t
+{
+    static const uint32_t TYPE_SHIFT = 0;
+    static const uint32_t TYPE_BITS = 3;
+    static const uint32_t AGE_SHIFT = TYPE_SHIFT + TYPE_BITS;
+    static const uint32_t AGE_BITS = 8;
+    static const uint32_t ENERGY_SHIFT = AGE_SHIFT + AGE_BITS;
+    static const uint32_t ENERGY_BITS = 12;
+    static const uint32_t FLAGS_SHIFT = ENERGY_SHIFT + ENERGY_BITS;
+    static const uint32_t FLAGS_BITS = 32 - FLAGS_SHIFT;
+
+    static const uint32_t TYPE_MASK = (1u << TYPE_BITS) - 1;
+    static const uint32_t AGE_MASK = (1u << AGE_BITS) - 1;
+    static const uint32_t ENERGY_MASK = (1u << ENERGY_BITS) - 1;
+    static const uint32_t FLAGS_MASK = (1u << FLAGS_BITS) - 1;
+
+    uint32_t bits = 0;
+
+    entity_type_t type() const { return (entity_type_t)((bits >> TYPE_SHIFT) & TYPE_MASK); }
+    int32_t age() const { return (int32_t)((bits >> AGE_SHIFT) & AGE_MASK); }
+    int32_t energy() const { return (int32_t)((bits >> ENERGY_SHIFT) & ENERGY_MASK); }
+    bool has_flag(uint32_t flag) const { return (bits >> FLAGS_SHIFT) & flag; }
+
+    void set_type(entity_type_t type) { set_field(TYPE_SHIFT, TYPE_MASK, (uint32_t)type); }
+    void set_age(int32_t age) { set_field(AGE_SHIFT, AGE_MASK, saturate(age, AGE_MASK)); }
+    void set_energy(int32_t energy) { set_field(ENERGY_SHIFT, ENERGY_MASK, saturate(energy, ENERGY_MASK)); }
+    void set_flag(uint32_t flag) { bits |= (flag & FLAGS_MASK) << FLAGS_SHIFT; }
+    void clear_flag(uint32_t flag) { bits &= ~((flag & FLAGS_MASK) << FLAGS_SHIFT); }
+
+private:
+    static uint32_t saturate(int32_t value, uint32_t max)
+    {
+        if (value < 0) return 0;
+        return (uint32_t)value > max ? max : (uint32_t)value;
+    }
+
+    void set_field(uint32_t shift, uint32_t mask, uint32_t value)
+    {
+        bits = (bits & ~(mask << shift)) | ((value & mask) << shift);
+    }
+};
+
+static_assert(sizeof(entity_t) == 4, "entity_t must stay packed in 32 bits");
+
+// Fields of an entity, for updates that only write some of them
+const uint32_t ENTITY_FIELD_TYPE = 1u << 0;
+const uint32_t ENTITY_FIELD_AGE = 1u << 1;
+const uint32_t ENTITY_FIELD_ENERGY = 1u << 2;
+const uint32_t ENTITY_FIELD_FLAGS = 1u << 3;
+const uint32_t ENTITY_ALL_FIELDS = ENTITY_FIELD_TYPE | ENTITY_FIELD_AGE | ENTITY_FIELD_ENERGY | ENTITY_FIELD_FLAGS;
+
+// Fields that differ between two entities, compared in registers
+inline uint32_t changed_fields(entity_t before, entity_t after) {
+    uint32_t diff = before.bits ^ after.bits;
+    uint32_t fields = 0;
+    if ((diff >> entity_t::TYPE_SHIFT) & entity_t::TYPE_MASK) fields |= ENTITY_FIELD_TYPE;
+    if ((diff >> entity_t::AGE_SHIFT) & entity_t::AGE_MASK) fields |= ENTITY_FIELD_AGE;
+    if ((diff >> entity_t::ENERGY_SHIFT) & entity_t::ENERGY_MASK) fields |= ENTITY_FIELD_ENERGY;
+    if ((diff >> entity_t::FLAGS_SHIFT) & entity_t::FLAGS_MASK) fields |= ENTITY_FIELD_FLAGS;
+    return fields;
+}
+
+// Array-of-structures storage: one packed entity_t per cell
+struct packed_storage_t
+{
+    std::vector<entity_t> cells;
+
+    void resize(size_t num_cells) { cells.assign(num_cells, entity_t()); }
+    size_t size() const { return cells.size(); }
+
+    entity_type_t type(size_t k) const { return cells[k].type(); }
+    int32_t age(size_t k) const { return cells[k].age(); }
+    int32_t energy(size_t k) const { return cells[k].energy(); }
+    bool has_flag(size_t k, uint32_t flag) const { return cells[k].has_flag(flag); }
+    entity_t get(size_t k) const { return cells[k]; }
+
+    // The whole word is stored whatever fields changed
+    void put(size_t k, entity_t e, uint32_t = ENTITY_ALL_FIELDS) { cells[k] = e; }
+    void clear(size_t first, size_t last) { std::fill(cells.begin() + first, cells.begin() + last, entity_t()); }
+    void set_type(size_t k, entity_type_t type) { cells[k].set_type(type); }
+    void set_age(size_t k, int32_t age) { cells[k].set_age(age); }
+    void set_energy(size_t k, int32_t energy) { cells[k].set_energy(energy); }
+    void set_flag(size_t k, uint32_t flag) { cells[k].set_flag(flag); }
+    void clear_flag(size_t k, uint32_t flag) { cells[k].clear_flag(flag); }
+};
+
+// Structure-of-arrays storage: one plane per field, so a neighbour scan
+// only pulls the type plane into cache
+struct soa_storage_t
+{
+    std::vector<uint8_t> types;
+    std::vector<uint8_t> ages;
+    std::vector<uint16_t> energies;
+    std::vector<uint8_t> flags;
+
+    void resize(size_t num_cells)
+    {
+        types.assign(num_cells, empty);
+        ages.assign(num_cells, 0);
+        energies.assign(num_cells, 0);
+        flags.assign(num_cells, 0);
+    }
+    size_t size() const { return types.size(); }
+
+    entity_type_t type(size_t k) const { return (entity_type_t)types[k]; }
+    int32_t age(size_t k) const { return ages[k]; }
+    int32_t energy(size_t k) const { return energies[k]; }
+    bool has_flag(size_t k, uint32_t flag) const { return flags[k] & flag; }
+    entity_t get(size_t k) const
+    {
+        entity_t e;
+        e.set_type(type(k));
+        e.set_age(age(k));
+        e.set_energy(energy(k));
+        e.set_flag(flags[k]);
+        return e;
+    }
+
+    // Writes only the planes of the given fields, so an update leaves the
+    // planes of the fields it does not change untouched
+    void put(size_t k, entity_t e, uint32_t fields = ENTITY_ALL_FIELDS)
+    {
+        if (fields & ENTITY_FIELD_TYPE) types[k] = (uint8_t)e.type();
+        if (fields & ENTITY_FIELD_AGE) ages[k] = (uint8_t)e.age();
+        if (fields & ENTITY_FIELD_ENERGY) energies[k] = (uint16_t)e.energy();
+        if (fields & ENTITY_FIELD_FLAGS) flags[k] = (uint8_t)(e.bits >> entity_t::FLAGS_SHIFT);
+    }
+    void clear(size_t first, size_t last)
+    {
+        std::fill(types.begin() + first, types.begin() + last, (uint8_t)empty);
+        std::fill(ages.begin() + first, ages.begin() + last, 0);
+        std::fill(energies.begin() + first, energies.begin() + last, 0);
+        std::fill(flags.begin() + first, flags.begin() + last, 0);
+    }
+
+    // Same saturation limits as the packed encoding, so both layouts simulate identically
+    void set_type(size_t k, entity_type_t type) { types[k] = (uint8_t)type; }
+    void set_age(size_t k, int32_t age) { ages[k] = (uint8_t)clamp(age, entity_t::AGE_MASK); }
+    void set_energy(size_t k, int32_t energy) { energies[k] = (uint16_t)clamp(energy, entity_t::ENERGY_MASK); }
+    void set_flag(size_t k, uint32_t flag) { flags[k] |= (uint8_t)flag; }
+    void clear_flag(size_t k, uint32_t flag) { flags[k] &= (uint8_t)~flag; }
+
+private:
+    static uint32_t clamp(int32_t value, uint32_t max)
+    {
+        if (value < 0) return 0;
+        return (uint32_t)value > max ? max : (uint32_t)value;
+    }
+};
+
+// Grid that contains the entities, stored row-major in the given layout.
+// The rows are padded with a one-cell border of walls, so every cell (i, j)
+// with 0 <= i < height and 0 <= j < width has four neighbours in storage and
+// rows -1 and height, columns -1 and width are valid indices.
+// On a torus the edges wrap around instead of meeting the walls.
+template <typename storage_t>
+struct grid_t : storage_t
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t stride = 0;
+    bool torus = false;
+
+    // Offset from a cell to its neighbour in each direction, per row or per
+    // column. Cells on the edge point at the wall, or across the torus, so
+    // both topologies share the same branchless neighbour lookup.
+    std::vector<ptrdiff_t> down;
+    std::vector<ptrdiff_t> up;
+    std::vector<ptrdiff_t> right;
+    std::vector<ptrdiff_t> left;
+
+    void resize(uint32_t width, uint32_t height, bool torus = false)
+    {
+        this->width = width;
+        this->height = height;
+        this->torus = torus;
+        stride = width + 2;
+        storage_t::resize((size_t)stride * (height + 2));
+
+        down.assign(height, (ptrdiff_t)stride);
+        up.assign(height, -(ptrdiff_t)stride);
+        right.assign(width, 1);
+        left.assign(width, -1);
+        if (torus) {
+            down[height - 1] = -(ptrdiff_t)stride * (height - 1);
+            up[0] = (ptrdiff_t)stride * (height - 1);
+            right[width - 1] = -(ptrdiff_t)(width - 1);
+            left[0] = (ptrdiff_t)(width - 1);
+        }
+
+        for (int j=-1; j<=(int)width; j++) {
+            this->set_type(index(-1, j), wall);
+            this->set_type(index(height, j), wall);
+        }
+        for (int i=0; i<(int)height; i++) {
+            this->set_type(index(i, -1), wall);
+            this->set_type(index(i, width), wall);
+        }
+    }
+
+    size_t index(int i, int j) const { return (size_t)(i + 1) * stride + (j + 1); }
+
+    // Like index, but a row or column one step past the edge wraps around on
+    // a torus. Not meant for the hot loop.
+    size_t wrapped_index(int i, int j) const
+    {
+        if (torus) {
+            if (i < 0) i += height;
+            else if (i >= (int)height) i -= height;
+            if (j < 0) j += width;
+            else if (j >= (int)width) j -= width;
+        }
+        return index(i, j);
+    }
+
+    // Writes the von Neumann neighbours of (i, j) into out and returns how
+    // many there are. Neighbours past the edge are walls, which no species
+    // moves into, so there are always four and no bounds checks.
+    size_t neighbours(int i, int j, size_t out[4]) const
+    {
+        size_t k = index(i, j);
+        out[0] = k + down[i];
+        out[1] = k + up[i];
+        out[2] = k + right[j];
+        out[3] = k + left[j];
+        return 4;
+    }
+
+    // Copies the opposite edges of a torus into the border, so code that
+    // reads the padding directly sees the wrapped neighbours
+    void refresh_ghosts()
+    {
+        if (!torus) return;
+        for (int j=0; j<(int)width; j++) {
+            this->put(index(-1, j), this->get(index(height - 1, j)));
+            this->put(index(height, j), this->get(index(0, j)));
+        }
+        for (int i=0; i<(int)height; i++) {
+            this->put(index(i, -1), this->get(index(i, width - 1)));
+            this->put(index(i, width), this->get(index(i, 0)));
+        }
+    }
+};
+
+typedef grid_t<packed_storage_t> packed_grid_t;
+typedef grid_t<soa_storage_t> soa_grid_t;
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Fixed table of mutexes shared by every cell of the grid. A cell is guarded
+// by the stripe its index hashes to, so lock memory does not depend on the
+// grid size and nothing is allocated when the simulation restarts.
+class lock_table_t
+{
+public:
+    static const size_t NUM_STRIPES = 4096;
+    static const size_t MAXIMUM_LOCKED_CELLS = 5;
+
+    size_t stripe_of(size_t cell) const
+    {
+        // Fibonacci hashing spreads neighbouring cells over distant stripes
+        return (size_t)(((uint64_t)cell * 0x9E3779B97F4A7C15ull) >> (64 - STRIPE_BITS));
+    }
+
+    std::mutex& stripe(size_t k) { return stripes[k].m; }
+
+private:
+    static const uint32_t STRIPE_BITS = 12;
+    static_assert((1u << STRIPE_BITS) == NUM_STRIPES, "NUM_STRIPES must match STRIPE_BITS");
+
+    // Each mutex sits on its own cache line so unrelated stripes do not false-share
+    struct alignas(64) padded_mutex_t
+    {
+        std::mutex m;
+    };
+
+    std::array<padded_mutex_t, NUM_STRIPES> stripes;
+};
+
+// Holds the stripes guarding a small set of cells for the lifetime of the
+// object. Stripes are taken in ascending order and only once each, so two
+// overlapping sets can never deadlock.
+class stripe_lock_t
+{
+public:
+    stripe_lock_t(lock_table_t& table, const size_t* cells, size_t count) : table(table)
+    {
+        for (size_t n = 0; n < count; n++) {
+            held[n] = table.stripe_of(cells[n]);
+        }
+        std::sort(held.begin(), held.begin() + count);
+        num_held = std::unique(held.begin(), held.begin() + count) - held.begin();
+
+        for (size_t n = 0; n < num_held; n++) {
+            table.stripe(held[n]).lock();
+        }
+    }
+
+    ~stripe_lock_t()
+    {
+        for (size_t n = num_held; n > 0; n--) {
+            table.stripe(held[n - 1]).unlock();
+        }
+    }
+
+    stripe_lock_t(const stripe_lock_t&) = delete;
+    stripe_lock_t& operator=(const stripe_lock_t&) = delete;
+
+private:
+    lock_table_t& table;
+    std::array<size_t, lock_table_t::MAXIMUM_LOCKED_CELLS> held;
+    size_t num_held = 0;
+};
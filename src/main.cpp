@@ -3,457 +3,520 @@
 
 #include "crow_all.h"
 #include "json.hpp"
+#include "engine.hpp"
+#include "frame_writer.hpp"
+#include "tick_sequencer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <memory>
 #include <random>
-#include <thread>
 #include <mutex>
-
-
-static const uint32_t NUM_ROWS = 15;
-
-// Constants
-const uint32_t PLANT_MAXIMUM_AGE = 10;
-const uint32_t HERBIVORE_MAXIMUM_AGE = 50;
-const uint32_t CARNIVORE_MAXIMUM_AGE = 80;
-const uint32_t MAXIMUM_ENERGY = 200;
-const uint32_t THRESHOLD_ENERGY_FOR_REPRODUCTION = 20;
-
-// Probabilities
-const double PLANT_REPRODUCTION_PROBABILITY = 0.2;
-const double HERBIVORE_REPRODUCTION_PROBABILITY = 0.075;
-const double CARNIVORE_REPRODUCTION_PROBABILITY = 0.025;
-const double HERBIVORE_MOVE_PROBABILITY = 0.7;
-const double HERBIVORE_EAT_PROBABILITY = 0.9;
-const double CARNIVORE_MOVE_PROBABILITY = 0.5;
-const double CARNIVORE_EAT_PROBABILITY = 1.0;
-
-// Type definitions
-enum entity_type_t
+#include <thread>
+#include <unordered_map>
+#include <variant>
+
+
+// Default world size, used when /start-simulation does not provide one
+static const uint32_t DEFAULT_NUM_ROWS = 15;
+static const uint32_t DEFAULT_NUM_COLUMNS = 15;
+static const uint64_t MAXIMUM_NUM_CELLS = 1ull << 28;
+static const uint32_t MAXIMUM_NUM_THREADS = 256;
+
+// Most iterations a single /advance request may run
+static const uint64_t MAXIMUM_NUM_STEPS = 1000000;
+
+// Threads serving HTTP requests. Handlers that wait for an iteration hold
+// one each, so there must be enough left for concurrent readers.
+static const uint16_t NUM_HTTP_THREADS = 16;
+
+// Iterations kept for ?since= deltas, within a budget for their change lists,
+// and the memory budget for the whole frames kept for GET /state?tick=. The
+// latest iteration is always kept whole, whatever its size.
+static const size_t MAXIMUM_RETAINED_FRAMES = 32;
+static const size_t MAXIMUM_RETAINED_CHANGE_BYTES = 64 << 20;
+static const size_t MAXIMUM_RETAINED_BYTES = 64 << 20;
+
+// Fastest rate /autoplay accepts, in iterations per second (0 means unlimited)
+static const double MAXIMUM_AUTOPLAY_RATE = 10000;
+
+// Grid that contains the entities, in the layout chosen by /start-simulation,
+// together with the state of the engine that advances it
+static std::variant<world_t<packed_grid_t>, world_t<soa_grid_t>> simulation;
+
+// Workers that run the simulation of each iteration. Replaced when
+// /start-simulation asks for a different number of threads.
+static std::unique_ptr<thread_pool_t> tick_pool(new thread_pool_t());
+
+// Serialises restarts and iterations, and guards the state below
+static std::mutex simulation_mutex;
+
+// Number of completed iterations since the last restart
+static uint64_t current_tick = 0;
+
+// Number of restarts, so frames of different runs with the same tick differ
+static uint64_t current_run = 0;
+
+// Snapshot of one completed iteration. Only the binary frame with every
+// plane is written when the iteration is published; the JSON frame and the
+// other encodings are written for the first client that asks for them. Each
+// encoding is made once and handed to every client that asks for it by
+// reference, so serialising costs the same whatever the number of viewers. Older frames
+// lose their encodings before their change list, which is all a delta
+// starting from them needs.
+struct frame_t
 {
-    empty,
-    plant,
-    herbivore,
-    carnivore
-};
+    uint64_t run = 0;
+    uint64_t tick = 0;
+    std::shared_ptr<std::string> json;  // null until a client asks for JSON
+    std::shared_ptr<std::string> binary;
 
-struct pos_t
-{
-    uint32_t i;
-    uint32_t j;
-};
+    // Cells (row-major) that differ from the previous frame of the same run,
+    // and the cells among them whose type differs
+    std::vector<uint32_t> changed;
+    std::vector<uint32_t> retyped;
 
-struct entity_t
-{
-    entity_type_t type;
-    int32_t energy;
-    int32_t age;
-    bool already_iterated;
-    std::mutex* m;
-};
+    // Plane selections and deltas, encoded for the first client that asked
+    // for each and shared with the later ones; keyed by frame_etag
+    std::vector<std::pair<std::string, std::shared_ptr<const std::string>>> encodings;
 
-// Auxiliary code to convert the entity_type_t enum to a string
-NLOHMANN_JSON_SERIALIZE_ENUM(entity_type_t, {
-                                                {empty, " "},
-                                                {plant, "P"},
-                                                {herbivore, "H"},
-                                                {carnivore, "C"},
-                                            })
+    // False once the encodings have been dropped
+    bool whole() const { return binary != nullptr; }
 
-// Auxiliary code to convert the entity_t struct to a JSON object
-namespace nlohmann
-{
-    void to_json(nlohmann::json &j, const entity_t &e)
+    size_t body_bytes() const
     {
-        j = nlohmann::json{{"type", e.type}, {"energy", e.energy}, {"age", e.age}};
+        if (!whole()) return 0;
+        size_t total = binary->size() + (json ? json->size() : 0);
+        for (const auto& encoding : encodings) total += encoding.second->size();
+        return total;
     }
-}
 
-// Grid that contains the entities
-static std::vector<std::vector<entity_t>> entity_grid;
+    size_t change_bytes() const { return (changed.size() + retyped.size()) * sizeof(uint32_t); }
+};
 
-bool random_action(float probability) {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    std::uniform_real_distribution<> dis(0.0, 1.0);
-    return dis(gen) < probability;
+// Recently published iterations, oldest first; the back is the latest.
+// Changed while holding both simulation_mutex and frame_mutex. Readers take
+// frame_mutex, which also guards the encodings cached in each frame, so
+// readers that do not advance the simulation never wait for a tick.
+static std::deque<frame_t> published_frames;
+static size_t retained_bytes = 0;
+static size_t retained_change_bytes = 0;
+static std::mutex frame_mutex;
+
+// Storage of the last encodings and change list dropped from
+// published_frames, reused to serialise the next frame once no client
+// holds its buffers any more
+static frame_t spare_frame;
+
+// Buffer of a dropped frame if nobody else holds it, or a new one
+std::shared_ptr<std::string> recycle(std::shared_ptr<std::string> buffer) {
+    if (buffer && buffer.use_count() == 1) return buffer;
+    return std::make_shared<std::string>();
 }
 
-void simulate_plant(int i, int j) {
+// Background thread that advances the simulation on its own, configured by
+// /autoplay. A rate of 0 runs iterations back to back.
+static std::thread autoplay_thread;
+static std::mutex autoplay_mutex;
+static std::condition_variable autoplay_cv;
+static bool autoplay_enabled = false;
+static double autoplay_rate = 0;
+static uint64_t autoplay_generation = 0;
+static bool autoplay_stopping = false;
+
+// Striped locks guarding the cells while an entity is being simulated
+static lock_table_t cell_locks;
+
+// Lets concurrent /next-iteration requests share one iteration
+static tick_sequencer_t next_iteration_sequencer;
+
+// Serialises the grid together with the iteration it belongs to
+template <typename grid_type>
+void publish(const grid_type& grid) {
+    // spare_frame is only touched by the thread publishing, under simulation_mutex
+    frame_t published = std::move(spare_frame);
+    published.run = current_run;
+    published.tick = current_tick;
+    published.json.reset();
+    published.binary = recycle(std::move(published.binary));
+    write_binary_frame(*published.binary, current_tick, grid);
+    published.changed.clear();
+    published.retyped.clear();
+    published.encodings.clear();
+    if (!published_frames.empty() && published_frames.back().run == current_run) {
+        diff_binary_frames(*published_frames.back().binary, *published.binary, published.changed, published.retyped);
+    }
 
-    std::lock_guard<std::mutex> lock1(*entity_grid[i][j].m);
-    if(i+1 < 15) std::lock_guard<std::mutex> lock2(*entity_grid[i+1][j].m);
-    if(i-1 >= 0) std::lock_guard<std::mutex> lock3(*entity_grid[i-1][j].m);
-    if(j+1 < 15) std::lock_guard<std::mutex> lock4(*entity_grid[i][j+1].m);
-    if(j-1 >= 0) std::lock_guard<std::mutex> lock5(*entity_grid[i][j-1].m);
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    if (!published_frames.empty() && published_frames.back().run != current_run) {
+        published_frames.clear();
+        retained_bytes = 0;
+        retained_change_bytes = 0;
+    }
+    retained_bytes += published.body_bytes();
+    retained_change_bytes += published.change_bytes();
+    published_frames.push_back(std::move(published));
+
+    // Drop the encodings of the oldest iterations once over budget, but keep
+    // their change lists so deltas can still start from them
+    for (size_t n = 0; n + 1 < published_frames.size() && retained_bytes > MAXIMUM_RETAINED_BYTES; n++) {
+        frame_t& frame = published_frames[n];
+        if (!frame.whole()) continue;
+        retained_bytes -= frame.body_bytes();
+        spare_frame.binary = std::move(frame.binary);
+        frame.json.reset();
+        frame.encodings.clear();
+    }
 
+    // Forget the oldest iterations altogether once over the change budget
+    while (published_frames.size() > 1 &&
+           (published_frames.size() > MAXIMUM_RETAINED_FRAMES || retained_change_bytes > MAXIMUM_RETAINED_CHANGE_BYTES)) {
+        frame_t& oldest = published_frames.front();
+        retained_bytes -= oldest.body_bytes();
+        retained_change_bytes -= oldest.change_bytes();
+        if (oldest.whole()) spare_frame.binary = std::move(oldest.binary);
+        spare_frame.changed = std::move(oldest.changed);
+        spare_frame.retyped = std::move(oldest.retyped);
+        published_frames.pop_front();
+    }
+}
 
-    std::vector<pos_t> possible_growth_positions;
+// Wire format a client asked for: JSON unless it sends
+// Accept: application/octet-stream or ?format=bin, in which case ?planes=age,energy
+// adds those planes to the binary frame. With ?since=N, only the cells that
+// changed after iteration N are sent, if N is still retained.
+struct frame_format_t
+{
+    bool binary = false;
+    uint32_t planes = FRAME_PLANE_TYPE;
+    bool delta = false;
+    uint64_t since = 0;
+};
 
-    if(i+1 < 15) {
-        if (entity_grid[i+1][j].type == empty) {
-        pos_t possible_position;
-        possible_position.i = i+1;
-        possible_position.j = j;
-        possible_growth_positions.push_back(possible_position);
-        }
+bool parse_frame_format(const crow::request& req, frame_format_t& format) {
+    const char *format_param = req.url_params.get("format");
+    if (format_param) {
+        std::string name = format_param;
+        if (name != "json" && name != "bin") return false;
+        format.binary = name == "bin";
     }
-    
-    if(i-1 >= 0) {
-        if (entity_grid[i-1][j].type == empty) {
-        pos_t possible_position;
-        possible_position.i = i-1;
-        possible_position.j = j;
-        possible_growth_positions.push_back(possible_position);
-        }
-    }
-    
-    if(j+1 < 15) {
-        if (entity_grid[i][j+1].type == empty) {
-        pos_t possible_position;
-        possible_position.i = i;
-        possible_position.j = j+1;
-        possible_growth_positions.push_back(possible_position);
-        }
+    else {
+        format.binary = req.get_header_value("Accept").find("application/octet-stream") != std::string::npos;
     }
-    
-    if(j-1 >= 0) {
-        if (entity_grid[i][j-1].type == empty) {
-        pos_t possible_position;
-        possible_position.i = i;
-        possible_position.j = j-1;
-        possible_growth_positions.push_back(possible_position);
+
+    const char *planes_param = req.url_params.get("planes");
+    if (planes_param) {
+        std::string planes = planes_param;
+        size_t first = 0;
+        while (first <= planes.size()) {
+            size_t last = std::min(planes.find(',', first), planes.size());
+            std::string plane = planes.substr(first, last - first);
+            if (plane == "type") format.planes |= FRAME_PLANE_TYPE;
+            else if (plane == "age") format.planes |= FRAME_PLANE_AGE;
+            else if (plane == "energy") format.planes |= FRAME_PLANE_ENERGY;
+            else return false;
+            first = last + 1;
         }
     }
-    
-
-    if (!possible_growth_positions.empty()) {
-        if(random_action(PLANT_REPRODUCTION_PROBABILITY)) {
-            std::random_device rd;  
-            std::mt19937 generator(rd());  
-            std::uniform_int_distribution<int> distribution(0, possible_growth_positions.size() - 1);
-            
-            pos_t selected_growth_position = possible_growth_positions[distribution(generator)];
-            entity_grid[selected_growth_position.i][selected_growth_position.j].type = plant;
-            entity_grid[selected_growth_position.i][selected_growth_position.j].energy = 0;
-            entity_grid[selected_growth_position.i][selected_growth_position.j].age = 0;
-            entity_grid[selected_growth_position.i][selected_growth_position.j].already_iterated = true;
-        }
 
+    const char *since_param = req.url_params.get("since");
+    if (since_param) {
+        char *end;
+        format.since = std::strtoull(since_param, &end, 10);
+        if (*since_param == '\0' || *end != '\0') return false;
+        format.delta = true;
     }
-
-    entity_grid[i][j].age += 1;  //increase age
-
-    if (entity_grid[i][j].age == PLANT_MAXIMUM_AGE) {  //decompose
-        entity_grid[i][j].type = empty;
-        entity_grid[i][j].energy = 0;
-        entity_grid[i][j].age = 0;
-    }
-
+    return true;
 }
 
-void simulate_herbivore(int i, int j) {
-
-    std::lock_guard<std::mutex> lock1(*entity_grid[i][j].m);
-    if(i+1 < 15) std::lock_guard<std::mutex> lock2(*entity_grid[i+1][j].m);
-    if(i-1 >= 0) std::lock_guard<std::mutex> lock3(*entity_grid[i-1][j].m);
-    if(j+1 < 15) std::lock_guard<std::mutex> lock4(*entity_grid[i][j+1].m);
-    if(j-1 >= 0) std::lock_guard<std::mutex> lock5(*entity_grid[i][j-1].m);
-    
-    std::vector<pos_t> empty_neighbours;
-    std::vector<pos_t> plant_neighbours;
-
-    if(i+1 < 15) {
-        
-        if (entity_grid[i+1][j].type == empty) {   
-            pos_t possible_position;
-            possible_position.i = i+1;
-            possible_position.j = j;
-            empty_neighbours.push_back(possible_position);
-        }
-        else if (entity_grid[i+1][j].type == plant) {   
-            pos_t possible_position;
-            possible_position.i = i+1;
-            possible_position.j = j;
-            plant_neighbours.push_back(possible_position);
+// Validator of a published frame in the given format, unique across restarts
+std::string frame_etag(const frame_t& frame, const frame_format_t& format) {
+    std::string etag = std::to_string(frame.run) + "-" + std::to_string(frame.tick);
+    if (format.binary) etag += "-bin" + std::to_string(format.planes);
+    if (format.delta) etag += "-since" + std::to_string(format.since);
+    return "\"" + etag + "\"";
+}
 
-            
-        }
+// Writes the cells that changed between published_frames[first] and
+// published_frames[last] into body. A binary delta of the type plane alone
+// only lists the cells whose type changed.
+void encode_delta(std::string& body, size_t first, size_t last, const frame_format_t& format) {
+    bool types_only = format.binary && format.planes == FRAME_PLANE_TYPE;
+    std::vector<uint32_t> changed;
+    for (size_t n = first + 1; n <= last; n++) {
+        const std::vector<uint32_t>& cells = types_only ? published_frames[n].retyped : published_frames[n].changed;
+        changed.insert(changed.end(), cells.begin(), cells.end());
     }
-    
-    if(i-1 >= 0) {
-        
-        if (entity_grid[i-1][j].type == empty) {
-            pos_t possible_position;
-            possible_position.i = i-1;
-            possible_position.j = j;
-            empty_neighbours.push_back(possible_position);
-        }
-        else if (entity_grid[i-1][j].type == plant) {   
-            pos_t possible_position;
-            possible_position.i = i-1;
-            possible_position.j = j;
-            plant_neighbours.push_back(possible_position);
-        }
-    }
-    
-    if(j+1 < 15) {
-        
-        if (entity_grid[i][j+1].type == empty) {
-            pos_t possible_position;
-            possible_position.i = i;
-            possible_position.j = j+1;
-            empty_neighbours.push_back(possible_position);
-        }
-        else if (entity_grid[i][j+1].type == plant) {   
-            pos_t possible_position;
-            possible_position.i = i;
-            possible_position.j = j+1;
-            plant_neighbours.push_back(possible_position);
-        }
-    }
-    
-    if(j-1 >= 0) {
-        
-        if (entity_grid[i][j-1].type == empty) {
-            pos_t possible_position;
-            possible_position.i = i;
-            possible_position.j = j-1;
-            empty_neighbours.push_back(possible_position);
-        }
-        else if (entity_grid[i][j-1].type == plant) {   
-            pos_t possible_position;
-            possible_position.i = i;
-            possible_position.j = j-1;
-            plant_neighbours.push_back(possible_position);
-        }
+    if (last > first + 1) {
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
     }
 
-    if (!plant_neighbours.empty()) {
-        if (random_action(HERBIVORE_EAT_PROBABILITY)) {  //eating
+    const frame_t& frame = published_frames[last];
+    if (format.binary) write_binary_delta(body, published_frames[first].tick, *frame.binary, format.planes, changed);
+    else write_json_delta(body, published_frames[first].tick, *frame.binary, changed);
+}
 
-            std::random_device rd;  
-            std::mt19937 generator(rd());  
-            std::uniform_int_distribution<int> distribution(0, plant_neighbours.size() - 1);
-            
-            pos_t selected_eat_position = plant_neighbours[distribution(generator)];
-            entity_grid[selected_eat_position.i][selected_eat_position.j].type = herbivore;
-            entity_grid[selected_eat_position.i][selected_eat_position.j].energy = entity_grid[i][j].energy + 30;
-            entity_grid[selected_eat_position.i][selected_eat_position.j].age = entity_grid[i][j].age;
-            entity_grid[selected_eat_position.i][selected_eat_position.j].already_iterated = true;
+// JSON frame of a retained iteration, written from its binary frame the
+// first time a client asks for it. The caller holds frame_mutex.
+std::shared_ptr<const std::string> json_frame(frame_t& frame) {
+    if (!frame.json) {
+        frame.json = std::make_shared<std::string>();
+        write_json_frame(*frame.json, *frame.binary);
+        retained_bytes += frame.json->size();
+    }
+    return frame.json;
+}
 
-            entity_grid[i][j].type = empty;
-            entity_grid[i][j].energy = 0;
-            entity_grid[i][j].age = 0;
+// Encodes published_frames[position] in the client's format: a delta when
+// it asked for one, the base iteration is retained and the delta is smaller
+// than the whole frame, the whole frame otherwise. Each encoding is made
+// once per frame and then shared, so the caller must hold frame_mutex and
+// not change the buffer.
+std::shared_ptr<const std::string> encode_frame(size_t position, frame_format_t format) {
+    frame_t& frame = published_frames[position];
+    size_t base = position + 1;
+    for (size_t n = 0; format.delta && n <= position; n++) {
+        if (published_frames[n].tick == format.since) base = n;
+    }
+    format.delta = base <= position;
 
-            entity_grid[selected_eat_position.i][selected_eat_position.j].age += 1;
+    if (!format.delta && !format.binary) return json_frame(frame);
+    if (!format.delta && format.planes == FRAME_ALL_PLANES) return frame.binary;
 
-        }
-        else entity_grid[i][j].age += 1;
+    std::string key = frame_etag(frame, format);
+    for (const auto& encoding : frame.encodings) {
+        if (encoding.first == key) return encoding.second;
     }
 
-    else if (!empty_neighbours.empty()) {    //reproduction
-        if(entity_grid[i][j].energy > THRESHOLD_ENERGY_FOR_REPRODUCTION) {
-            if (random_action(HERBIVORE_REPRODUCTION_PROBABILITY)) {
-                entity_grid[i][j].energy -= 10;
-
-                std::random_device rd;  
-                std::mt19937 generator(rd());  
-                std::uniform_int_distribution<int> distribution(0, empty_neighbours.size() - 1);
-                
-                pos_t selected_birth_position = empty_neighbours[distribution(generator)];
-                entity_grid[selected_birth_position.i][selected_birth_position.j].type = herbivore;
-                entity_grid[selected_birth_position.i][selected_birth_position.j].energy = 100;
-                entity_grid[selected_birth_position.i][selected_birth_position.j].age = 0;
-                entity_grid[selected_birth_position.i][selected_birth_position.j].already_iterated = true;
-
-            }
-            
+    std::shared_ptr<const std::string> body;
+    if (format.delta) {
+        std::shared_ptr<std::string> delta = std::make_shared<std::string>();
+        encode_delta(*delta, base, position, format);
+        body = delta;
+
+        // Once nearly every cell has changed, the whole frame is smaller. The
+        // JSON frame is only written when the delta could be as large as it.
+        size_t num_cells = (frame.binary->size() - BINARY_FRAME_HEADER_SIZE) / 4;
+        bool larger;
+        if (format.binary) larger = delta->size() >= BINARY_FRAME_HEADER_SIZE + num_cells * plane_bytes(format.planes);
+        else larger = delta->size() >= num_cells * MINIMUM_JSON_CELL_LENGTH && delta->size() >= json_frame(frame)->size();
+        if (larger) {
+            frame_format_t whole = format;
+            whole.delta = false;
+            body = encode_frame(position, whole);
         }
-        entity_grid[i][j].age += 1;
     }
+    else {
+        std::shared_ptr<std::string> selection = std::make_shared<std::string>();
+        select_planes(*frame.binary, format.planes, *selection);
+        body = selection;
+    }
+    frame.encodings.emplace_back(key, body);
+    retained_bytes += body->size();
+    return body;
+}
 
+// Puts a frame encoded by encode_frame into the response. Crow sends the body
+// from a string of its own, so the shared buffer is copied; callers must not
+// hold frame_mutex, so readers and publish() never wait behind the copy.
+void write_frame(crow::response& res, const std::string& body, const frame_format_t& format) {
+    res.add_header("Vary", "Accept");
+    if (format.binary) res.add_header("Content-Type", "application/octet-stream");
+    res.body = body;
+}
 
-    else if (!empty_neighbours.empty()) {                               //movement
-        if(random_action(HERBIVORE_MOVE_PROBABILITY)) {
-            std::random_device rd;  
-            std::mt19937 generator(rd());  
-            std::uniform_int_distribution<int> distribution(0, empty_neighbours.size() - 1);
-            
-            pos_t selected_move_position = empty_neighbours[distribution(generator)];
-            entity_grid[selected_move_position.i][selected_move_position.j].type = herbivore;
-            entity_grid[selected_move_position.i][selected_move_position.j].energy = entity_grid[i][j].energy - 5;
-            entity_grid[selected_move_position.i][selected_move_position.j].age = entity_grid[i][j].age;
-            entity_grid[selected_move_position.i][selected_move_position.j].already_iterated = true;
-
-            entity_grid[i][j].type = empty;
-            entity_grid[i][j].energy = 0;
-            entity_grid[i][j].age = 0;
+// Encoding of the latest published iteration in the client's format
+std::shared_ptr<const std::string> encode_latest_frame(const frame_format_t& format) {
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    return encode_frame(published_frames.size() - 1, format);
+}
 
-            entity_grid[selected_move_position.i][selected_move_position.j].age += 1;
-        }
-        else entity_grid[i][j].age += 1;
-    }
+// A client of /ws, which is sent every published iteration: the whole frame
+// first, then the cells that changed since the last one it was sent. At most
+// one message is in flight per client; iterations published meanwhile are
+// merged into the next delta, so a slow client skips iterations instead of
+// queueing them.
+struct subscriber_t
+{
+    // Tells this client apart from a later one that reuses its address
+    uint64_t id = 0;
+    frame_format_t format;
+    // Iteration of the last message handed to the connection
+    uint64_t run = 0;
+    uint64_t tick = 0;
+    // True until that message has been written to the socket
+    bool sending = false;
+};
 
-    
+// Clients connected to /ws, guarded by subscriber_mutex
+static std::unordered_map<crow::websocket::connection*, subscriber_t> subscribers;
+static uint64_t num_subscribers_opened = 0;
+static std::mutex subscriber_mutex;
+
+// Format asked for by the /ws upgrade being accepted. Crow calls the accept
+// and open handlers of a connection back to back on the same thread.
+static thread_local frame_format_t accepted_format;
+
+void send_latest(crow::websocket::connection& conn, subscriber_t& subscriber);
+
+// Hands a message to the I/O thread of a subscribed connection. Crow deletes
+// a closed connection on that thread, right after its close handler has
+// unsubscribed it, so the message is only sent if the connection is still
+// subscribed by then. Crow 1.0 queues a copy of the payload per connection;
+// the encoding itself is shared. Once the message has been written, the
+// subscriber is sent whatever was published meanwhile. The caller holds
+// subscriber_mutex.
+void deliver(crow::websocket::connection& conn, uint64_t id, bool binary, std::shared_ptr<const std::string> body) {
+    auto& socket = static_cast<crow::websocket::Connection<crow::SocketAdaptor>&>(conn);
+    socket.post([&conn, &socket, id, binary, body] {
+        std::lock_guard<std::mutex> lock(subscriber_mutex);
+        auto found = subscribers.find(&conn);
+        if (found == subscribers.end() || found->second.id != id) return;
+        if (binary) conn.send_binary(*body);
+        else conn.send_text(*body);
+
+        socket.when_written([&conn, id] {
+            std::lock_guard<std::mutex> lock(subscriber_mutex);
+            auto found = subscribers.find(&conn);
+            if (found == subscribers.end() || found->second.id != id) return;
+            found->second.sending = false;
+            std::lock_guard<std::mutex> frame_lock(frame_mutex);
+            send_latest(conn, found->second);
+        });
+    });
+}
 
-    if(entity_grid[i][j].energy == 0 ||          //death
-        entity_grid[i][j].age == HERBIVORE_MAXIMUM_AGE) {
+// Sends the latest published iteration to a subscriber that has not been
+// sent it yet, unless a message to it is still in flight. Subscribers that
+// were sent the same iteration in the same format share one encoding. The
+// caller holds subscriber_mutex and frame_mutex.
+void send_latest(crow::websocket::connection& conn, subscriber_t& subscriber) {
+    if (published_frames.empty() || subscriber.sending) return;
+    const frame_t& frame = published_frames.back();
+    if (subscriber.run == frame.run && subscriber.tick == frame.tick) return;
+
+    // A new run starts over from a whole frame
+    frame_format_t format = subscriber.format;
+    format.delta = subscriber.run == frame.run;
+    format.since = subscriber.tick;
+    deliver(conn, subscriber.id, format.binary, encode_frame(published_frames.size() - 1, format));
+
+    subscriber.run = frame.run;
+    subscriber.tick = frame.tick;
+    subscriber.sending = true;
+}
 
-            entity_grid[i][j].type = empty;
-            entity_grid[i][j].energy = 0;
-            entity_grid[i][j].age = 0;
-    }                
+// Sends the iteration just published to every /ws client. Must be called
+// with simulation_mutex held.
+void push_to_subscribers() {
+    std::lock_guard<std::mutex> lock(subscriber_mutex);
+    std::lock_guard<std::mutex> frame_lock(frame_mutex);
+    for (auto& entry : subscribers) send_latest(*entry.first, entry.second);
 }
 
-void simulate_carnivore(int i, int j) {
+// Advances the simulation by one iteration without publishing it. Must be
+// called with simulation_mutex held.
+template <typename grid_type>
+void step(world_t<grid_type>& world) {
+    // Reset: prepare the buffers the engine writes
+    begin_tick(*tick_pool, world);
 
-    std::lock_guard<std::mutex> lock1(*entity_grid[i][j].m);
-    if(i+1 < 15) std::lock_guard<std::mutex> lock2(*entity_grid[i+1][j].m);
-    if(i-1 >= 0) std::lock_guard<std::mutex> lock3(*entity_grid[i-1][j].m);
-    if(j+1 < 15) std::lock_guard<std::mutex> lock4(*entity_grid[i][j+1].m);
-    if(j-1 >= 0) std::lock_guard<std::mutex> lock5(*entity_grid[i][j-1].m);
+    // Simulate: every chunk of rows, on the worker pool
+    simulate_tick(*tick_pool, cell_locks, world);
 
+    // Barrier: wait until every chunk has been applied
+    tick_pool->join();
+    end_tick(world);
+    current_tick++;
+}
 
-    std::vector<pos_t> empty_neighbours;
-    std::vector<pos_t> herbivore_neighbours;
+// Advances the simulation by one iteration and publishes it. Must be called
+// with simulation_mutex held; the published frame always describes a
+// finished iteration, never one that workers are still writing.
+template <typename grid_type>
+void run_tick(world_t<grid_type>& world) {
+    step(world);
 
-    if(i+1 < 15) {
-        if (entity_grid[i+1][j].type == empty) {   
-            pos_t possible_position;
-            possible_position.i = i+1;
-            possible_position.j = j;
-            empty_neighbours.push_back(possible_position);
-        }
-        else if (entity_grid[i+1][j].type == herbivore) {   
-            pos_t possible_position;
-            possible_position.i = i+1;
-            possible_position.j = j;
-            herbivore_neighbours.push_back(possible_position);
+    // Publish: snapshot the completed iteration and push it to /ws clients
+    publish(world.grid);
+    push_to_subscribers();
+}
 
-            
+// Number of entities of each species, for responses that skip the grid
+template <typename grid_type>
+nlohmann::json population_summary(const grid_type& grid) {
+    uint64_t counts[4] = {0, 0, 0, 0};
+    for (uint32_t i = 0; i < grid.height; i++) {
+        for (uint32_t j = 0; j < grid.width; j++) {
+            counts[grid.type(grid.index(i, j))]++;
         }
     }
-    
-    if(i-1 >= 0) {
-        if (entity_grid[i-1][j].type == empty) {
-            pos_t possible_position;
-            possible_position.i = i-1;
-            possible_position.j = j;
-            empty_neighbours.push_back(possible_position);
-        }
-        else if (entity_grid[i-1][j].type == herbivore) {   
-            pos_t possible_position;
-            possible_position.i = i-1;
-            possible_position.j = j;
-            herbivore_neighbours.push_back(possible_position);
-        }
-    }
-    
-    if(j+1 < 15) {
-        if (entity_grid[i][j+1].type == empty) {
-            pos_t possible_position;
-            possible_position.i = i;
-            possible_position.j = j+1;
-            empty_neighbours.push_back(possible_position);
-        }
-        else if (entity_grid[i][j+1].type == herbivore) {   
-            pos_t possible_position;
-            possible_position.i = i;
-            possible_position.j = j+1;
-            herbivore_neighbours.push_back(possible_position);
-        }
-    }
-    
-    if(j-1 >= 0) {
-        if (entity_grid[i][j-1].type == empty) {
-            pos_t possible_position;
-            possible_position.i = i;
-            possible_position.j = j-1;
-            empty_neighbours.push_back(possible_position);
-        }
-        else if (entity_grid[i][j-1].type == herbivore) {   
-            pos_t possible_position;
-            possible_position.i = i;
-            possible_position.j = j-1;
-            herbivore_neighbours.push_back(possible_position);
-        }
-    }
-
-    if (!herbivore_neighbours.empty()) {
-        if (random_action(CARNIVORE_EAT_PROBABILITY)) {  //eating
-
-            std::random_device rd;  
-            std::mt19937 generator(rd());  
-            std::uniform_int_distribution<int> distribution(0, herbivore_neighbours.size() - 1);
-            
-            pos_t selected_eat_position = herbivore_neighbours[distribution(generator)];
-            entity_grid[selected_eat_position.i][selected_eat_position.j].type = carnivore;
-            entity_grid[selected_eat_position.i][selected_eat_position.j].energy = entity_grid[i][j].energy + 20;
-            entity_grid[selected_eat_position.i][selected_eat_position.j].age = entity_grid[i][j].age;
-            entity_grid[selected_eat_position.i][selected_eat_position.j].already_iterated = true;
+    return nlohmann::json{
+        {"tick", current_tick},
+        {"plants", counts[plant]},
+        {"herbivores", counts[herbivore]},
+        {"carnivores", counts[carnivore]},
+    };
+}
 
-            entity_grid[i][j].type = empty;
-            entity_grid[i][j].energy = 0;
-            entity_grid[i][j].age = 0;
+// Places count entities of the given type on random empty cells
+template <typename grid_type>
+void place_entities(grid_type& grid, std::mt19937_64& gen, entity_type_t type, uint64_t count, int32_t energy) {
+    std::uniform_int_distribution<> dis_i(0, grid.height - 1);
+    std::uniform_int_distribution<> dis_j(0, grid.width - 1);
 
-            entity_grid[selected_eat_position.i][selected_eat_position.j].age += 1;
+    for (uint64_t n=0; n<count; n++) {
+        int random_i = dis_i(gen);
+        int random_j = dis_j(gen);
 
+        while (grid.type(grid.index(random_i, random_j)) != empty) {
+            random_i = dis_i(gen);
+            random_j = dis_j(gen);
         }
-        else entity_grid[i][j].age += 1;
+
+        grid.set_type(grid.index(random_i, random_j), type);
+        grid.set_age(grid.index(random_i, random_j), 0);
+        grid.set_energy(grid.index(random_i, random_j), energy);
     }
+}
 
-    else if (!empty_neighbours.empty()) {    //reproduction
-        if(entity_grid[i][j].energy > THRESHOLD_ENERGY_FOR_REPRODUCTION) {
-            if (random_action(CARNIVORE_REPRODUCTION_PROBABILITY)) {
-                entity_grid[i][j].energy -= 10;
-
-                std::random_device rd;  
-                std::mt19937 generator(rd());  
-                std::uniform_int_distribution<int> distribution(0, empty_neighbours.size() - 1);
-                
-                pos_t selected_birth_position = empty_neighbours[distribution(generator)];
-                entity_grid[selected_birth_position.i][selected_birth_position.j].type = carnivore;
-                entity_grid[selected_birth_position.i][selected_birth_position.j].energy = 100;
-                entity_grid[selected_birth_position.i][selected_birth_position.j].age = 0;
-                entity_grid[selected_birth_position.i][selected_birth_position.j].already_iterated = true;
+// Body of autoplay_thread: runs iterations at the configured rate until the
+// server shuts down. Changing the configuration restarts the schedule.
+void autoplay_loop() {
+    std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(autoplay_mutex);
+    for (;;) {
+        autoplay_cv.wait(lock, [] { return autoplay_stopping || autoplay_enabled; });
+        if (autoplay_stopping) return;
+
+        if (autoplay_rate > 0) {
+            uint64_t generation = autoplay_generation;
+            bool reconfigured = autoplay_cv.wait_until(lock, due, [generation] {
+                return autoplay_stopping || autoplay_generation != generation;
+            });
+            if (reconfigured) {
+                due = std::chrono::steady_clock::now();
+                continue;
             }
-            
         }
-        entity_grid[i][j].age += 1;
-    }
-
-
-    else if (!empty_neighbours.empty()) {                               //movement
-        if(random_action(CARNIVORE_MOVE_PROBABILITY)) {
-            std::random_device rd;  
-            std::mt19937 generator(rd());  
-            std::uniform_int_distribution<int> distribution(0, empty_neighbours.size() - 1);
-            
-            pos_t selected_move_position = empty_neighbours[distribution(generator)];
-            entity_grid[selected_move_position.i][selected_move_position.j].type = carnivore;
-            entity_grid[selected_move_position.i][selected_move_position.j].energy = entity_grid[i][j].energy - 5;
-            entity_grid[selected_move_position.i][selected_move_position.j].age = entity_grid[i][j].age;
-            entity_grid[selected_move_position.i][selected_move_position.j].already_iterated = true;
+        std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(autoplay_rate > 0 ? 1.0 / autoplay_rate : 0.0));
+        lock.unlock();
 
-            entity_grid[i][j].type = empty;
-            entity_grid[i][j].energy = 0;
-            entity_grid[i][j].age = 0;
-
-            entity_grid[selected_move_position.i][selected_move_position.j].age += 1;
+        {
+            std::lock_guard<std::mutex> simulation_lock(simulation_mutex);
+            std::visit([](auto &world) { run_tick(world); }, simulation);
         }
-        else entity_grid[i][j].age += 1;
-    }
-
-    
 
-    if(entity_grid[i][j].energy == 0 ||          //death
-        entity_grid[i][j].age == CARNIVORE_MAXIMUM_AGE) {
-
-            entity_grid[i][j].type = empty;
-            entity_grid[i][j].energy = 0;
-            entity_grid[i][j].age = 0;
+        // Keep to the schedule, but do not try to catch up after falling behind
+        due = std::max(due + period, std::chrono::steady_clock::now());
+        lock.lock();
     }
-                        
 }
+
 int main()
 {
     crow::SimpleApp app;
@@ -472,129 +535,311 @@ int main()
         // Parse the JSON request body
         nlohmann::json request_body = nlohmann::json::parse(req.body);
 
-       // Validate the request body 
-        uint32_t total_entinties = (uint32_t)request_body["plants"] + (uint32_t)request_body["herbivores"] + (uint32_t)request_body["carnivores"];
-        if (total_entinties > NUM_ROWS * NUM_ROWS) {
+        frame_format_t format;
+        if (!parse_frame_format(req, format)) {
         res.code = 400;
-        res.body = "Too many entities";
+        res.body = "Invalid format";
         res.end();
         return;
         }
 
-        // Clear the entity grid
-        entity_grid.clear();
-        entity_grid.assign(NUM_ROWS, std::vector<entity_t>(NUM_ROWS, { empty, 0, 0, false, new std::mutex()}));
-        for(int i=0; i<15; i++) {
-            for(int j=0; j<15; j++) {
-                entity_grid[i][j].m = new std::mutex();
-            }
+       // Validate the request body 
+        uint32_t width = request_body.value("width", DEFAULT_NUM_COLUMNS);
+        uint32_t height = request_body.value("height", DEFAULT_NUM_ROWS);
+        if (width == 0 || height == 0 || (uint64_t)width * height > MAXIMUM_NUM_CELLS) {
+        res.code = 400;
+        res.body = "Invalid grid size";
+        res.end();
+        return;
         }
-        
-        // Create the entities
-        // <YOUR CODE HERE>
-        for (int i=0; i<(uint32_t)request_body["plants"]; i++) {
 
-            static std::random_device rd;
-            static std::mt19937 gen(rd());
-            std::uniform_int_distribution<> dis(0, 14);
-            int random_i = dis(gen);
-            int random_j = dis(gen);
-
-            while (entity_grid[random_i][random_j].type != empty) {
-                random_i = dis(gen);
-                random_j = dis(gen);
-            }
-
-            entity_grid[random_i][random_j].type = plant;
-            entity_grid[random_i][random_j].age = 0;
-            entity_grid[random_i][random_j].energy = 0;
+        // Each count is checked on its own first, so the sum cannot wrap
+        uint64_t num_cells = (uint64_t)width * height;
+        uint64_t num_plants = request_body["plants"].get<uint64_t>();
+        uint64_t num_herbivores = request_body["herbivores"].get<uint64_t>();
+        uint64_t num_carnivores = request_body["carnivores"].get<uint64_t>();
+        if (num_plants > num_cells || num_herbivores > num_cells || num_carnivores > num_cells ||
+            num_plants + num_herbivores + num_carnivores > num_cells) {
+        res.code = 400;
+        res.body = "Too many entities";
+        res.end();
+        return;
         }
 
+        engine_t engine;
+        if (!parse_engine(request_body.value("engine", "locked"), engine)) {
+        res.code = 400;
+        res.body = "Invalid engine";
+        res.end();
+        return;
+        }
 
-        for (int i=0; i<(uint32_t)request_body["carnivores"]; i++) {
-
-            static std::random_device rd;
-            static std::mt19937 gen(rd());
-            std::uniform_int_distribution<> dis(0, 14);
-            int random_i = dis(gen);
-            int random_j = dis(gen);
-
-            while (entity_grid[random_i][random_j].type != empty) {
-                random_i = dis(gen);
-                random_j = dis(gen);
-            }
-           
-            entity_grid[random_i][random_j].type = carnivore;
-            entity_grid[random_i][random_j].age = 0;
-            entity_grid[random_i][random_j].energy = 100;
+        std::string layout = request_body.value("layout", "packed");
+        if (layout != "packed" && layout != "soa") {
+        res.code = 400;
+        res.body = "Invalid layout";
+        res.end();
+        return;
         }
 
-        for (int i=0; i<(uint32_t)request_body["herbivores"]; i++) {
+        std::string topology = request_body.value("topology", "bounded");
+        if (topology != "bounded" && topology != "torus") {
+        res.code = 400;
+        res.body = "Invalid topology";
+        res.end();
+        return;
+        }
+        bool torus = topology == "torus";
 
-            static std::random_device rd;
-            static std::mt19937 gen(rd());
-            std::uniform_int_distribution<> dis(0, 14);
-            int random_i = dis(gen);
-            int random_j = dis(gen);
+        // The same seed and parameters replay the same run, on any number of threads
+        uint64_t seed;
+        if (request_body.contains("seed")) {
+        if (!request_body["seed"].is_number_unsigned()) {
+        res.code = 400;
+        res.body = "Invalid seed";
+        res.end();
+        return;
+        }
+        if (!is_deterministic(engine)) {
+        res.code = 400;
+        res.body = "Seeded runs need the intent, checkerboard or tiled engine";
+        res.end();
+        return;
+        }
+        seed = request_body["seed"].get<uint64_t>();
+        }
+        else {
+        std::random_device rd;
+        seed = ((uint64_t)rd() << 32) | rd();
+        }
 
-            while (entity_grid[random_i][random_j].type != empty) {
-                random_i = dis(gen);
-                random_j = dis(gen);
-            }
+        uint32_t threads = request_body.value("threads", 0u);
+        if (threads > MAXIMUM_NUM_THREADS) {
+        res.code = 400;
+        res.body = "Invalid thread count";
+        res.end();
+        return;
+        }
 
-            entity_grid[random_i][random_j].type = herbivore;
-            entity_grid[random_i][random_j].age = 0;
-            entity_grid[random_i][random_j].energy = 100;
+        // The five colours only tile a torus whose sides are multiples of five
+        if (torus && engine == engine_checkerboard && (width % NUM_COLOURS != 0 || height % NUM_COLOURS != 0)) {
+        res.code = 400;
+        res.body = "Checkerboard torus needs a width and height multiple of 5";
+        res.end();
+        return;
         }
 
+        std::unique_lock<std::mutex> lock(simulation_mutex);
 
+        if (threads != 0 && threads != tick_pool->size()) tick_pool.reset(new thread_pool_t(threads));
 
-        // Return the JSON representation of the entity grid
-        nlohmann::json json_grid = entity_grid; 
-        res.body = json_grid.dump();
+        // Clear the entity grid
+        if (layout == "soa") simulation.emplace<world_t<soa_grid_t>>();
+        else simulation.emplace<world_t<packed_grid_t>>();
+
+        std::visit([&](auto &world) {
+            world.reset(engine, width, height, torus, tick_pool->size());
+            world.seed = seed;
+            auto &grid = world.grid;
+
+            // Create the entities
+            std::mt19937_64 gen(seed);
+            place_entities(grid, gen, plant, num_plants, 0);
+            place_entities(grid, gen, carnivore, num_carnivores, 100);
+            place_entities(grid, gen, herbivore, num_herbivores, 100);
+
+            // Publish the initial state as iteration 0
+            current_tick = 0;
+            current_run++;
+            publish(grid);
+            push_to_subscribers();
+        }, simulation);
+
+        // Return the representation of the entity grid
+        std::shared_ptr<const std::string> body = encode_latest_frame(format);
+        lock.unlock();
+        res.add_header("X-Simulation-Seed", std::to_string(seed));
+        write_frame(res, *body, format);
         res.end(); });
 
     // Endpoint to process HTTP GET requests for the next simulation iteration
     CROW_ROUTE(app, "/next-iteration")
-        .methods("GET"_method)([]()
+        .methods("GET"_method)([](const crow::request &req, crow::response &res)
                                {
+        frame_format_t format;
+        if (!parse_frame_format(req, format)) {
+        res.code = 400;
+        res.body = "Invalid format";
+        res.end();
+        return;
+        }
+
         // Simulate the next iteration
         // Iterate over the entity grid and simulate the behaviour of each entity
         
         // <YOUR CODE HERE>
-        for (int i=0; i<15; i++) {
-            for (int j=0; j<15; j++) {
-                entity_grid[i][j].already_iterated = false;
-            }
+        next_iteration_sequencer.request([] {
+            std::lock_guard<std::mutex> lock(simulation_mutex);
+            std::visit([](auto &world) { run_tick(world); }, simulation);
+        });
+
+        // Return the representation of the entity grid
+        write_frame(res, *encode_latest_frame(format), format);
+        res.end(); });
+
+    // Endpoint to run several iterations back to back and return only the last
+    CROW_ROUTE(app, "/advance")
+        .methods("POST"_method)([](crow::request &req, crow::response &res)
+                                {
+        nlohmann::json request_body = nlohmann::json::parse(req.body);
+
+        frame_format_t format;
+        if (!parse_frame_format(req, format)) {
+        res.code = 400;
+        res.body = "Invalid format";
+        res.end();
+        return;
         }
 
-        for (int i=0; i<15; i++) {
-            for (int j=0; j<15; j++) {
-
-                if (!entity_grid[i][j].already_iterated) {
-                    if (entity_grid[i][j].type == plant) {
-                        std::thread t_plant(simulate_plant, i, j);
-                        t_plant.detach();
-                    }
-                    else if (entity_grid[i][j].type == herbivore) {
-                        std::thread t_herbivore(simulate_herbivore, i, j);
-                        t_herbivore.detach();
-                    }
-                    else if (entity_grid[i][j].type == carnivore) {
-                        std::thread t_carnivore(simulate_carnivore, i, j);
-                        t_carnivore.detach();
-                    }
-                    
-                }
-            }
+        if (!request_body["steps"].is_number_unsigned() ||
+            request_body["steps"].get<uint64_t>() == 0 || request_body["steps"].get<uint64_t>() > MAXIMUM_NUM_STEPS) {
+        res.code = 400;
+        res.body = "Invalid number of steps";
+        res.end();
+        return;
         }
-               
-                
-        
-        // Return the JSON representation of the entity grid
-        nlohmann::json json_grid = entity_grid; 
-        return json_grid.dump(); });
-    app.port(8080).run();
+        uint64_t steps = request_body["steps"].get<uint64_t>();
+        bool summary = request_body.value("summary", false);
+
+        std::shared_ptr<const std::string> body;
+        {
+            std::lock_guard<std::mutex> lock(simulation_mutex);
+            std::visit([&](auto &world) {
+                for (uint64_t n = 1; n < steps; n++) step(world);
+                run_tick(world);
+                if (summary) res.body = population_summary(world.grid).dump();
+            }, simulation);
+            if (!summary) body = encode_latest_frame(format);
+        }
+
+        // Return the final state, or only its population when asked to
+        if (!summary) write_frame(res, *body, format);
+        res.end(); });
+    // Endpoint to read a published iteration without advancing the simulation:
+    // the latest one, or ?tick=N while it is still retained
+    CROW_ROUTE(app, "/state")
+        .methods("GET"_method)([](const crow::request &req, crow::response &res)
+                               {
+        frame_format_t format;
+        if (!parse_frame_format(req, format)) {
+        res.code = 400;
+        res.body = "Invalid format";
+        res.end();
+        return;
+        }
+
+        const char *tick_param = req.url_params.get("tick");
+        uint64_t tick = 0;
+        if (tick_param) {
+        char *end;
+        tick = std::strtoull(tick_param, &end, 10);
+        if (*tick_param == '\0' || *end != '\0') {
+        res.code = 400;
+        res.body = "Invalid tick";
+        res.end();
+        return;
+        }
+        }
+
+        std::unique_lock<std::mutex> lock(frame_mutex);
+        size_t position = published_frames.size();
+        if (!tick_param && !published_frames.empty()) position = published_frames.size() - 1;
+        for (size_t n = 0; tick_param && n < published_frames.size(); n++) {
+            if (published_frames[n].tick == tick && published_frames[n].whole()) position = n;
+        }
+        if (position == published_frames.size()) {
+        res.code = 404;
+        res.body = "Tick not retained";
+        res.end();
+        return;
+        }
+
+        // Reads are idempotent, so clients and caches can revalidate with the ETag
+        std::string etag = frame_etag(published_frames[position], format);
+        res.add_header("ETag", etag);
+        res.add_header("Cache-Control", "no-cache");
+        if (req.get_header_value("If-None-Match") == etag) {
+        res.code = 304;
+        res.end();
+        return;
+        }
+        std::shared_ptr<const std::string> body = encode_frame(position, format);
+        lock.unlock();
+        write_frame(res, *body, format);
+        res.end(); });
+
+    // Endpoint to let the server advance the simulation on its own.
+    // {"enabled": true, "rate": 20} runs 20 iterations per second, rate 0 as fast as possible.
+    CROW_ROUTE(app, "/autoplay")
+        .methods("POST"_method)([](crow::request &req, crow::response &res)
+                                {
+        nlohmann::json request_body = nlohmann::json::parse(req.body);
+
+        double rate = request_body.value("rate", 0.0);
+        if (!(rate >= 0 && rate <= MAXIMUM_AUTOPLAY_RATE)) {
+        res.code = 400;
+        res.body = "Invalid rate";
+        res.end();
+        return;
+        }
+
+        bool enabled = request_body.value("enabled", true);
+        {
+            std::lock_guard<std::mutex> lock(autoplay_mutex);
+            autoplay_enabled = enabled;
+            autoplay_rate = rate;
+            autoplay_generation++;
+        }
+        autoplay_cv.notify_all();
+
+        res.body = nlohmann::json{{"enabled", enabled}, {"rate", rate}}.dump();
+        res.end(); });
+
+    // Endpoint that pushes every published iteration to the client as soon as
+    // it exists: the whole frame, then only the cells that changed since the
+    // previous message. Takes the same ?format=, ?planes= and ?since= as /state.
+    CROW_ROUTE(app, "/ws")
+        .websocket()
+        .onaccept([](const crow::request &req)
+                  {
+        accepted_format = frame_format_t();
+        return parse_frame_format(req, accepted_format); })
+        .onopen([](crow::websocket::connection &conn)
+                {
+        std::lock_guard<std::mutex> lock(subscriber_mutex);
+        std::lock_guard<std::mutex> frame_lock(frame_mutex);
+        subscriber_t &subscriber = subscribers[&conn];
+        subscriber.id = ++num_subscribers_opened;
+        subscriber.format = accepted_format;
+        if (accepted_format.delta && !published_frames.empty()) {
+            subscriber.run = published_frames.back().run;
+            subscriber.tick = accepted_format.since;
+        }
+        send_latest(conn, subscriber); })
+        .onclose([](crow::websocket::connection &conn, const std::string &)
+                 {
+        std::lock_guard<std::mutex> lock(subscriber_mutex);
+        subscribers.erase(&conn); });
+
+    autoplay_thread = std::thread(autoplay_loop);
+    app.port(8080).concurrency(NUM_HTTP_THREADS).run();
+
+    {
+        std::lock_guard<std::mutex> lock(autoplay_mutex);
+        autoplay_stopping = true;
+    }
+    autoplay_cv.notify_all();
+    autoplay_thread.join();
 
     return 0;
 }
\ No newline at end of file
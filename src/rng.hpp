@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+// A counter-based generator: the output is a pure function of a 128-bit
+// counter and a 64-bit key, so any block of the stream can be computed
+// directly, by any thread, without shared state.
+inline void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int round = 0; round < 10; round++) {
+        if (round > 0) {
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+        uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// Computes the first Philox block of count cells at once: cells first_cell,
+// first_cell + step, ..., writing 4 words per cell into out. The lanes are
+// independent, so the compiler turns the rounds into SIMD multiplies; the
+// result is the same as calling philox4x32 on each cell's first counter.
+inline void philox4x32_cells(uint64_t seed, uint64_t tick, size_t first_cell, size_t step, size_t count, uint32_t* out) {
+    const size_t LANES = 8;
+    for (size_t first = 0; first < count; first += LANES) {
+        uint32_t c0[LANES], c1[LANES], c2[LANES], c3[LANES];
+        for (size_t l = 0; l < LANES; l++) {
+            c0[l] = (uint32_t)(first_cell + (first + l) * step);
+            c1[l] = 0;
+            c2[l] = (uint32_t)tick;
+            c3[l] = (uint32_t)(tick >> 32);
+        }
+
+        uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+        for (int round = 0; round < 10; round++) {
+            if (round > 0) {
+                k0 += 0x9E3779B9u;
+                k1 += 0xBB67AE85u;
+            }
+            for (size_t l = 0; l < LANES; l++) {
+                uint64_t p0 = (uint64_t)0xD2511F53u * c0[l];
+                uint64_t p1 = (uint64_t)0xCD9E8D57u * c2[l];
+                uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1[l] ^ k0;
+                uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3[l] ^ k1;
+                c1[l] = (uint32_t)p1;
+                c3[l] = (uint32_t)p0;
+                c0[l] = n0;
+                c2[l] = n2;
+            }
+        }
+
+        size_t lanes = count - first < LANES ? count - first : LANES;
+        for (size_t l = 0; l < lanes; l++) {
+            uint32_t* block = out + 4 * (first + l);
+            block[0] = c0[l];
+            block[1] = c1[l];
+            block[2] = c2[l];
+            block[3] = c3[l];
+        }
+    }
+}
+
+// Probability as an integer threshold: a uniform 32-bit draw below it has
+// that probability. 64 bits wide so that a probability of 1 always passes.
+constexpr uint64_t probability_threshold(double probability) {
+    return probability <= 0.0 ? 0
+         : probability >= 1.0 ? (1ull << 32)
+         : (uint64_t)(probability * 4294967296.0);
+}
+
+// Random stream of one cell during one iteration, keyed by (seed, tick, cell).
+// Whichever thread simulates the cell, and in whatever order, it draws the
+// same numbers.
+class cell_rng_t
+{
+public:
+    cell_rng_t(uint64_t seed, uint64_t tick, uint32_t cell)
+    {
+        key[0] = (uint32_t)seed;
+        key[1] = (uint32_t)(seed >> 32);
+        counter[0] = cell;
+        counter[1] = 0;
+        counter[2] = (uint32_t)tick;
+        counter[3] = (uint32_t)(tick >> 32);
+    }
+
+    // Same stream, starting from a first block computed by philox4x32_cells
+    cell_rng_t(uint64_t seed, uint64_t tick, uint32_t cell, const uint32_t first_block[4]) : cell_rng_t(seed, tick, cell)
+    {
+        for (int w = 0; w < 4; w++) block[w] = first_block[w];
+        counter[1] = 1;
+        used = 0;
+    }
+
+    uint32_t next()
+    {
+        if (used == 4) {
+            philox4x32(counter, key, block);
+            counter[1]++;
+            used = 0;
+        }
+        return block[used++];
+    }
+
+    // True with the probability given by probability_threshold
+    bool chance(uint64_t threshold) { return next() < threshold; }
+
+    // Uniform integer in [0, n), by multiply-shift instead of a division
+    size_t below(size_t n) { return (size_t)(((uint64_t)next() * n) >> 32); }
+
+private:
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t block[4];
+    uint32_t used = 4;
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "grid.hpp"
+#include "rng.hpp"
+
+// Constants
+const uint32_t PLANT_MAXIMUM_AGE = 10;
+const uint32_t HERBIVORE_MAXIMUM_AGE = 50;
+const uint32_t CARNIVORE_MAXIMUM_AGE = 80;
+const uint32_t MAXIMUM_ENERGY = 200;
+const uint32_t THRESHOLD_ENERGY_FOR_REPRODUCTION = 20;
+
+// Probabilities, turned into integer thresholds for the random draws
+constexpr double PLANT_REPRODUCTION_PROBABILITY = 0.2;
+constexpr double HERBIVORE_REPRODUCTION_PROBABILITY = 0.075;
+constexpr double CARNIVORE_REPRODUCTION_PROBABILITY = 0.025;
+constexpr double HERBIVORE_MOVE_PROBABILITY = 0.7;
+constexpr double HERBIVORE_EAT_PROBABILITY = 0.9;
+constexpr double CARNIVORE_MOVE_PROBABILITY = 0.5;
+constexpr double CARNIVORE_EAT_PROBABILITY = 1.0;
+constexpr uint64_t PLANT_REPRODUCTION_THRESHOLD = probability_threshold(PLANT_REPRODUCTION_PROBABILITY);
+
+// What an entity does to a neighbouring cell during one iteration
+enum action_kind_t
+{
+    action_none,
+    action_grow,
+    action_eat,
+    action_breed,
+    action_move
+};
+
+// Outcome of simulating one entity, computed without touching the grid.
+// self replaces the entity's own cell and spawned is written into target.
+// Engines that may fail to take the target cell (because another entity
+// got there first) leave fallback in the entity's cell instead.
+// self_fields and fallback_fields are the fields that differ from the
+// entity as it was, so engines updating in place write only those planes.
+struct action_t
+{
+    action_kind_t kind = action_none;
+    size_t target = 0;
+    entity_t self;
+    entity_t spawned;
+    entity_t fallback;
+    uint32_t self_fields = 0;
+    uint32_t fallback_fields = 0;
+};
+
+inline bool random_action(cell_rng_t& rng, uint64_t threshold) {
+    return rng.chance(threshold);
+}
+
+inline size_t random_choice(cell_rng_t& rng, const size_t* candidates, size_t count) {
+    return candidates[rng.below(count)];
+}
+
+// An animal dies when it runs out of energy or reaches its maximum age
+inline entity_t check_animal_death(entity_t e, uint32_t maximum_age) {
+    if (e.energy() == 0 || e.age() == (int32_t)maximum_age) return entity_t();
+    return e;
+}
+
+inline entity_t newborn(entity_type_t type, int32_t energy) {
+    entity_t e;
+    e.set_type(type);
+    e.set_energy(energy);
+    e.set_age(0);
+    e.set_flag(ENTITY_FLAG_ITERATED);
+    return e;
+}
+
+template <typename grid_type>
+action_t decide_plant(const grid_type& grid, int i, int j, cell_rng_t& rng) {
+
+    size_t neighbours[4];
+    size_t num_neighbours = grid.neighbours(i, j, neighbours);
+
+    size_t possible_growth_positions[4];
+    size_t num_growth_positions = 0;
+    for (size_t n = 0; n < num_neighbours; n++) {
+        if (grid.type(neighbours[n]) == empty) possible_growth_positions[num_growth_positions++] = neighbours[n];
+    }
+
+    action_t action;
+    action.self = grid.get(grid.index(i, j));
+
+    if (num_growth_positions != 0) {
+        if(random_action(rng, PLANT_REPRODUCTION_THRESHOLD)) {
+            action.kind = action_grow;
+            action.target = random_choice(rng, possible_growth_positions, num_growth_positions);
+            action.spawned = newborn(plant, 0);
+        }
+    }
+
+    action.self.set_age(action.self.age() + 1);  //increase age
+
+    if (action.self.age() == (int32_t)PLANT_MAXIMUM_AGE) {  //decompose
+        action.self = entity_t();
+    }
+
+    action.fallback = action.self;
+    return action;
+}
+
+// Compile-time description of an animal species. decide_animal is
+// instantiated once per traits struct, so every constant folds into the code.
+struct herbivore_traits_t
+{
+    static constexpr entity_type_t species = herbivore;
+    static constexpr entity_type_t prey = plant;
+    static constexpr uint32_t maximum_age = HERBIVORE_MAXIMUM_AGE;
+    static constexpr int32_t energy_gain = 30;
+    static constexpr uint64_t eat_threshold = probability_threshold(HERBIVORE_EAT_PROBABILITY);
+    static constexpr uint64_t reproduction_threshold = probability_threshold(HERBIVORE_REPRODUCTION_PROBABILITY);
+    static constexpr uint64_t move_threshold = probability_threshold(HERBIVORE_MOVE_PROBABILITY);
+};
+
+struct carnivore_traits_t
+{
+    static constexpr entity_type_t species = carnivore;
+    static constexpr entity_type_t prey = herbivore;
+    static constexpr uint32_t maximum_age = CARNIVORE_MAXIMUM_AGE;
+    static constexpr int32_t energy_gain = 20;
+    static constexpr uint64_t eat_threshold = probability_threshold(CARNIVORE_EAT_PROBABILITY);
+    static constexpr uint64_t reproduction_threshold = probability_threshold(CARNIVORE_REPRODUCTION_PROBABILITY);
+    static constexpr uint64_t move_threshold = probability_threshold(CARNIVORE_MOVE_PROBABILITY);
+};
+
+template <typename traits, typename grid_type>
+action_t decide_animal(const grid_type& grid, int i, int j, cell_rng_t& rng) {
+
+    size_t neighbours[4];
+    size_t num_neighbours = grid.neighbours(i, j, neighbours);
+
+    size_t empty_neighbours[4];
+    size_t prey_neighbours[4];
+    size_t num_empty = 0;
+    size_t num_prey = 0;
+    for (size_t n = 0; n < num_neighbours; n++) {
+        if (grid.type(neighbours[n]) == empty) empty_neighbours[num_empty++] = neighbours[n];
+        else if (grid.type(neighbours[n]) == traits::prey) prey_neighbours[num_prey++] = neighbours[n];
+    }
+
+    action_t action;
+    action.self = grid.get(grid.index(i, j));
+
+    entity_t stayed = action.self;
+    stayed.set_age(stayed.age() + 1);
+    action.fallback = check_animal_death(stayed, traits::maximum_age);
+
+    if (num_prey != 0) {
+        if (random_action(rng, traits::eat_threshold)) {  //eating
+            action.kind = action_eat;
+            action.target = random_choice(rng, prey_neighbours, num_prey);
+            action.spawned = stayed;
+            action.spawned.set_energy(action.self.energy() + traits::energy_gain);
+            action.spawned.set_flag(ENTITY_FLAG_ITERATED);
+            action.self = entity_t();
+            return action;
+        }
+        else action.self = stayed;
+    }
+
+    else if (num_empty != 0) {    //reproduction
+        if(action.self.energy() > (int32_t)THRESHOLD_ENERGY_FOR_REPRODUCTION) {
+            if (random_action(rng, traits::reproduction_threshold)) {
+                action.kind = action_breed;
+                action.target = random_choice(rng, empty_neighbours, num_empty);
+                action.spawned = newborn(traits::species, 100);
+                stayed.set_energy(stayed.energy() - 10);
+            }
+        }
+        action.self = stayed;
+    }
+
+    else if (num_empty != 0) {                               //movement
+        if(random_action(rng, traits::move_threshold)) {
+            action.kind = action_move;
+            action.target = random_choice(rng, empty_neighbours, num_empty);
+            action.spawned = stayed;
+            action.spawned.set_energy(action.self.energy() - 5);
+            action.spawned.set_flag(ENTITY_FLAG_ITERATED);
+            action.self = entity_t();
+            return action;
+        }
+        else action.self = stayed;
+    }
+
+    action.self = check_animal_death(action.self, traits::maximum_age);  //death
+    return action;
+}
+
+// Decides what the entity in cell (i, j) does, reading the grid only and
+// drawing its random numbers from the cell's stream
+template <typename grid_type>
+action_t decide(const grid_type& grid, int i, int j, cell_rng_t& rng) {
+    entity_t before = grid.get(grid.index(i, j));
+    action_t action;
+    if (before.type() == plant) action = decide_plant(grid, i, j, rng);
+    else if (before.type() == herbivore) action = decide_animal<herbivore_traits_t>(grid, i, j, rng);
+    else if (before.type() == carnivore) action = decide_animal<carnivore_traits_t>(grid, i, j, rng);
+    else return action;
+
+    action.self_fields = changed_fields(before, action.self);
+    action.fallback_fields = changed_fields(before, action.fallback);
+    return action;
+}
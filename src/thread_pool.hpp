@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads that runs batches of indexed tasks.
+// A batch is spread over one deque per worker; a worker drains its own deque
+// from the front and, once it runs dry, steals from the back of the others.
+class thread_pool_t
+{
+public:
+    typedef std::function<void(size_t task, size_t worker)> task_fn_t;
+
+    explicit thread_pool_t(size_t num_workers = std::thread::hardware_concurrency())
+    {
+        num_workers = std::max<size_t>(num_workers, 1);
+        for (size_t w = 0; w < num_workers; w++) {
+            queues.emplace_back(new worker_queue_t());
+        }
+        for (size_t w = 0; w < num_workers; w++) {
+            workers.emplace_back(&thread_pool_t::worker_loop, this, w);
+        }
+    }
+
+    ~thread_pool_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            stopping = true;
+        }
+        work_cv.notify_all();
+        for (std::thread& t : workers) {
+            t.join();
+        }
+    }
+
+    thread_pool_t(const thread_pool_t&) = delete;
+    thread_pool_t& operator=(const thread_pool_t&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // Queues tasks 0..num_tasks-1 and returns immediately. Only one batch runs
+    // at a time, so this waits for the previous batch to be joined first.
+    void dispatch(size_t num_tasks, task_fn_t fn)
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        idle_cv.wait(lock, [&] { return pending == 0; });
+        if (num_tasks == 0) return;
+
+        batch_fn = std::move(fn);
+        pending = num_tasks;
+        for (size_t task = 0; task < num_tasks; task++) {
+            worker_queue_t& q = *queues[task % queues.size()];
+            std::lock_guard<std::mutex> queue_lock(q.m);
+            q.tasks.push_back(task);
+        }
+        generation++;
+        lock.unlock();
+        work_cv.notify_all();
+    }
+
+    // Join point: blocks until every task of the current batch has finished
+    void join()
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        idle_cv.wait(lock, [&] { return pending == 0; });
+    }
+
+    // Runs a whole batch and waits for it
+    void run(size_t num_tasks, task_fn_t fn)
+    {
+        dispatch(num_tasks, std::move(fn));
+        join();
+    }
+
+private:
+    struct alignas(64) worker_queue_t
+    {
+        std::mutex m;
+        std::deque<size_t> tasks;
+    };
+
+    bool pop_own(size_t worker, size_t& task)
+    {
+        worker_queue_t& q = *queues[worker];
+        std::lock_guard<std::mutex> lock(q.m);
+        if (q.tasks.empty()) return false;
+        task = q.tasks.front();
+        q.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(size_t worker, size_t& task)
+    {
+        for (size_t n = 1; n < queues.size(); n++) {
+            worker_queue_t& q = *queues[(worker + n) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.m);
+            if (q.tasks.empty()) continue;
+            task = q.tasks.back();
+            q.tasks.pop_back();
+            return true;
+        }
+        return false;
+    }
+
+    void worker_loop(size_t worker)
+    {
+        uint64_t seen_generation = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(pool_mutex);
+                work_cv.wait(lock, [&] { return stopping || generation != seen_generation; });
+                if (stopping) return;
+                seen_generation = generation;
+            }
+
+            size_t task;
+            while (pop_own(worker, task) || steal(worker, task)) {
+                batch_fn(task, worker);
+
+                std::lock_guard<std::mutex> lock(pool_mutex);
+                if (--pending == 0) idle_cv.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<worker_queue_t>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex pool_mutex;
+    std::condition_variable work_cv;
+    std::condition_variable idle_cv;
+    task_fn_t batch_fn;
+    size_t pending = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
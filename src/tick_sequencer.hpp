@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Coalesces concurrent requests for a new iteration. A request that arrives
+// while an iteration is running waits for that one and shares its result,
+// so any number of concurrent callers costs a single iteration.
+class tick_sequencer_t
+{
+public:
+    // Returns once the iteration running when the call arrived, or else a
+    // new one, has completed. run_tick is called by at most one caller at a time.
+    template <typename fn_t>
+    void request(fn_t run_tick)
+    {
+        std::unique_lock<std::mutex> lock(m);
+        uint64_t wanted = running ? started : started + 1;
+        for (;;) {
+            if (completed >= wanted) return;
+            if (!running) {
+                // Lead the iteration this caller and everyone waiting want
+                running = true;
+                started++;
+                lock.unlock();
+                try {
+                    run_tick();
+                }
+                catch (...) {
+                    finish();
+                    throw;
+                }
+                finish();
+                return;
+            }
+            done_cv.wait(lock);
+        }
+    }
+
+private:
+    void finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            running = false;
+            completed = started;
+        }
+        done_cv.notify_all();
+    }
+
+    std::mutex m;
+    std::condition_variable done_cv;
+    uint64_t started = 0;
+    uint64_t completed = 0;
+    bool running = false;
+};